@@ -24,32 +24,66 @@ DEALINGS IN THE SOFTWARE.
 #ifndef DRPC_HPP
 #define DRPC_HPP
 
+#include <algorithm>
 #include <bit>
 #include <cassert>
+#include <cerrno>
+#include <charconv>
+#include <cmath>
 #include <chrono>
 #include <cstdint>
+#include <condition_variable>
 #include <cstring>
+#include <deque>
 #include <format>
 #include <functional>
+#include <future>
 #include <map>
 #include <memory>
-#include <queue>
+#include <mutex>
+#include <optional>
 #include <random>
-#include <regex>
-#include <sstream>
+#include <ranges>
+#include <span>
 #include <thread>
-#include <variant>
 #include <vector>
 #include <string>
+#include <string_view>
+#include <tuple>
+#include <utility>
 #include <array>
+#include <atomic>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define DRPC_SIMD_AVX2
+#define DRPC_SIMD_SSE2
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define DRPC_SIMD_SSE2
+#elif defined(__ARM_NEON) || defined(_M_ARM64)
+#include <arm_neon.h>
+#define DRPC_SIMD_NEON
+#endif
 
 #ifdef _WIN32
+// Keeps Windows.h from defining min and max macros, which break std::min and std::max
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
 #include <Windows.h>
 #else
 #include <sys/socket.h>
 #include <sys/types.h>
 #include <sys/un.h>
-#include <sys/ioctl.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#endif
 #endif
 
 namespace DiscordRichPresence {
@@ -62,998 +96,4189 @@ namespace DiscordRichPresence {
             virtual void ToJson(JsonWriter* writer) const = 0;
         };
 
+        struct JsonMember;
+
+        /**
+         * @brief A JSON value packed into 24 bytes. Integers share a single 64-bit slot with a sign flag,
+         * strings of up to 16 bytes are stored inline and objects are a flat array of members in insertion order
+         */
         class JsonValue {
         public:
-            JsonValue(const std::string& string) : value(string) {}
-            JsonValue(const char* string) : value(string) {}
-            JsonValue(int32_t n) : value(n) {}
-            JsonValue(uint32_t n) : value(n) {}
-            JsonValue(int64_t n) : value(n) {}
-            JsonValue(uint64_t n) : value(n) {}
-            JsonValue(float n) : value(n) {}
-            JsonValue(double n) : value(n) {}
-            JsonValue(bool b) : value(b) {}
-            JsonValue(std::shared_ptr<JsonSerializable> serializable) : value(serializable) {}
-            JsonValue(std::vector<JsonValue> vec) : value(vec) {}
-            JsonValue(std::map<std::string, JsonValue> map) : value(map) {}
+            enum class Kind : uint8_t {
+                Null,
+                String,
+                Integer,
+                Float,
+                Bool,
+                Array,
+                Object,
+                Serializable
+            };
+
+            JsonValue(std::nullptr_t) : kind(Kind::Null) {}
+            JsonValue(std::string_view string) : kind(Kind::String) { AssignString(string); }
+            JsonValue(const std::string& string) : JsonValue(std::string_view(string)) {}
+            JsonValue(const char* string) : JsonValue(std::string_view(string)) {}
+            JsonValue(int32_t n) : JsonValue(static_cast<int64_t>(n)) {}
+            JsonValue(uint32_t n) : JsonValue(static_cast<uint64_t>(n)) {}
+            JsonValue(int64_t n) : kind(Kind::Integer), negative(n < 0), integer(static_cast<uint64_t>(n)) {}
+            JsonValue(uint64_t n) : kind(Kind::Integer), integer(n) {}
+            JsonValue(float n) : kind(Kind::Float), single(true), number(n) {}
+            JsonValue(double n) : kind(Kind::Float), number(n) {}
+            JsonValue(bool b) : kind(Kind::Bool), boolean(b) {}
+            JsonValue(std::shared_ptr<JsonSerializable> serializable) : kind(Kind::Serializable), serializable(std::move(serializable)) {}
+            JsonValue(std::vector<JsonValue> vec);
+            /**
+             * @brief Creates an object with its members sorted by key
+             */
+            JsonValue(std::map<std::string, JsonValue> map);
+            /**
+             * @brief Creates an object which keeps the order of members
+             */
+            JsonValue(std::vector<std::pair<std::string, JsonValue>> members);
+
+            JsonValue(const JsonValue& other) { CopyFrom(other); }
+            JsonValue(JsonValue&& other) noexcept { MoveFrom(std::move(other)); }
+            ~JsonValue() { Destroy(); }
+
+            JsonValue& operator=(const JsonValue& other) {
+                // other may live inside this value, e.g. v = v.GetArray()[0], so copy it before destroying
+                JsonValue copy(other);
+                Destroy();
+                MoveFrom(std::move(copy));
+                return *this;
+            }
+
+            JsonValue& operator=(JsonValue&& other) noexcept {
+                if (this != &other) {
+                    Destroy();
+                    MoveFrom(std::move(other));
+                }
+                return *this;
+            }
+
+            Kind GetKind() const {
+                return kind;
+            }
+
+            std::string_view GetString() const {
+                assert(kind == Kind::String);
+                return heap ? std::string_view(heap_string.data, heap_string.size) : std::string_view(small_string, small_size);
+            }
+
+            std::span<const JsonValue> GetArray() const {
+                assert(kind == Kind::Array);
+                return { array.data, array.size };
+            }
+
+            std::span<const JsonMember> GetObject() const;
 
             template<typename T>
             T get() const {
-                return std::get<T>(value);
+                if constexpr (std::is_same_v<T, std::string>) {
+                    return std::string(GetString());
+                } else if constexpr (std::is_same_v<T, bool>) {
+                    assert(kind == Kind::Bool);
+                    return boolean;
+                } else if constexpr (std::is_integral_v<T>) {
+                    assert(kind == Kind::Integer);
+                    return static_cast<T>(integer);
+                } else if constexpr (std::is_floating_point_v<T>) {
+                    assert(kind == Kind::Float);
+                    return static_cast<T>(number);
+                } else if constexpr (std::is_same_v<T, std::shared_ptr<JsonSerializable>>) {
+                    assert(kind == Kind::Serializable);
+                    return serializable;
+                } else if constexpr (std::is_same_v<T, std::vector<JsonValue>>) {
+                    auto items = GetArray();
+                    return std::vector<JsonValue>(items.begin(), items.end());
+                } else {
+                    static_assert(std::is_same_v<T, std::map<std::string, JsonValue>>);
+                    return ToMap();
+                }
+            }
+
+            /**
+             * @brief Calls f with the stored value: std::nullptr_t, std::string_view, int64_t/uint64_t,
+             * float/double, bool, std::span<const JsonValue>, std::span<const JsonMember> or
+             * std::shared_ptr<JsonSerializable>
+             */
+            template<typename F>
+            void Visit(F&& f) const {
+                switch (kind) {
+                case Kind::Null: f(nullptr); break;
+                case Kind::String: f(GetString()); break;
+                case Kind::Integer:
+                    if (negative) f(static_cast<int64_t>(integer));
+                    else f(integer);
+                    break;
+                case Kind::Float:
+                    if (single) f(static_cast<float>(number));
+                    else f(number);
+                    break;
+                case Kind::Bool: f(boolean); break;
+                case Kind::Array: f(GetArray()); break;
+                case Kind::Object: f(GetObject()); break;
+                case Kind::Serializable: f(serializable); break;
+                }
             }
 
             void ToJson(JsonWriter* writer) const;
         private:
-            std::variant<
-                std::string,
-                int32_t,
-                uint32_t,
-                int64_t,
-                uint64_t,
-                float,
-                double,
-                bool,
-                std::vector<JsonValue>,
-                std::map<std::string, JsonValue>,
-                std::shared_ptr<JsonSerializable>
-                > value;
+            struct HeapString {
+                char* data;
+                size_t size;
+            };
+
+            template<typename T>
+            struct Items {
+                T* data;
+                size_t size;
+            };
+
+            template<typename T>
+            static Items<T> AllocateItems(size_t size) {
+                return { size > 0 ? std::allocator<T>().allocate(size) : nullptr, size };
+            }
+
+            template<typename T>
+            static void FreeItems(Items<T> items) {
+                std::destroy_n(items.data, items.size);
+                if (items.data != nullptr)
+                    std::allocator<T>().deallocate(items.data, items.size);
+            }
+
+            void AssignString(std::string_view string) {
+                if (string.size() <= sizeof(small_string)) {
+                    heap = false;
+                    small_size = static_cast<uint8_t>(string.size());
+                    std::memcpy(small_string, string.data(), string.size());
+                } else {
+                    heap = true;
+                    heap_string = { new char[string.size()], string.size() };
+                    std::memcpy(heap_string.data, string.data(), string.size());
+                }
+            }
+
+            std::map<std::string, JsonValue> ToMap() const;
+            void CopyFrom(const JsonValue& other);
+            void MoveFrom(JsonValue&& other);
+            void Destroy();
+
+            Kind kind;
+            bool negative = false; // Integer: the slot holds an int64_t
+            bool single = false; // Float: the value was given as a float
+            bool heap = false; // String: the characters live in heap_string
+            uint8_t small_size = 0;
+
+            union {
+                uint64_t integer;
+                double number;
+                bool boolean;
+                char small_string[16];
+                HeapString heap_string;
+                Items<JsonValue> array;
+                Items<JsonMember> object;
+                std::shared_ptr<JsonSerializable> serializable;
+            };
         };
 
+        struct JsonMember {
+            JsonValue key;
+            JsonValue value;
+        };
+
+        inline JsonValue::JsonValue(std::vector<JsonValue> vec) : kind(Kind::Array) {
+            array = AllocateItems<JsonValue>(vec.size());
+            std::uninitialized_move(vec.begin(), vec.end(), array.data);
+        }
+
+        inline JsonValue::JsonValue(std::map<std::string, JsonValue> map) : kind(Kind::Object) {
+            object = AllocateItems<JsonMember>(map.size());
+            size_t i = 0;
+            for (auto& [key, value] : map)
+                std::construct_at(object.data + i++, JsonMember { key, std::move(value) });
+        }
+
+        inline JsonValue::JsonValue(std::vector<std::pair<std::string, JsonValue>> members) : kind(Kind::Object) {
+            object = AllocateItems<JsonMember>(members.size());
+            size_t i = 0;
+            for (auto& [key, value] : members)
+                std::construct_at(object.data + i++, JsonMember { key, std::move(value) });
+        }
+
+        inline std::span<const JsonMember> JsonValue::GetObject() const {
+            assert(kind == Kind::Object);
+            return { object.data, object.size };
+        }
+
+        inline std::map<std::string, JsonValue> JsonValue::ToMap() const {
+            std::map<std::string, JsonValue> map;
+            for (const auto& member : GetObject())
+                map.emplace(member.key.GetString(), member.value);
+            return map;
+        }
+
+        inline void JsonValue::CopyFrom(const JsonValue& other) {
+            kind = other.kind;
+            negative = other.negative;
+            single = other.single;
+
+            switch (kind) {
+            case Kind::String:
+                AssignString(other.GetString());
+                break;
+            case Kind::Array:
+                array = AllocateItems<JsonValue>(other.array.size);
+                std::uninitialized_copy_n(other.array.data, other.array.size, array.data);
+                break;
+            case Kind::Object:
+                object = AllocateItems<JsonMember>(other.object.size);
+                std::uninitialized_copy_n(other.object.data, other.object.size, object.data);
+                break;
+            case Kind::Serializable:
+                std::construct_at(&serializable, other.serializable);
+                break;
+            case Kind::Integer:
+                integer = other.integer;
+                break;
+            case Kind::Float:
+                number = other.number;
+                break;
+            case Kind::Bool:
+                boolean = other.boolean;
+                break;
+            case Kind::Null:
+                break;
+            }
+        }
+
+        inline void JsonValue::MoveFrom(JsonValue&& other) {
+            kind = other.kind;
+            negative = other.negative;
+            single = other.single;
+            heap = other.heap;
+            small_size = other.small_size;
+
+            if (kind == Kind::Serializable) {
+                std::construct_at(&serializable, std::move(other.serializable));
+                other.Destroy();
+            } else {
+                // Every other alternative is trivially relocatable, so ownership moves with the bytes
+                std::memcpy(small_string, other.small_string, sizeof(small_string));
+                other.kind = Kind::Null;
+            }
+        }
+
+        inline void JsonValue::Destroy() {
+            switch (kind) {
+            case Kind::String:
+                if (heap) delete[] heap_string.data;
+                break;
+            case Kind::Array:
+                FreeItems(array);
+                break;
+            case Kind::Object:
+                FreeItems(object);
+                break;
+            case Kind::Serializable:
+                std::destroy_at(&serializable);
+                break;
+            default:
+                break;
+            }
+            kind = Kind::Null;
+        }
+
+        constexpr bool NeedsEscape(unsigned char c) {
+            return c < 0x20 || c == '"' || c == '\\';
+        }
+
+        /**
+         * @brief Returns the index of the first character in str which has to be escaped, or str.size() if there is none
+         */
+        inline size_t FindEscape(std::string_view str) {
+            const char* data = str.data();
+            const size_t size = str.size();
+            size_t i = 0;
+
+            #ifdef DRPC_SIMD_AVX2
+            const __m256i quote32 = _mm256_set1_epi8('"');
+            const __m256i backslash32 = _mm256_set1_epi8('\\');
+            const __m256i control32 = _mm256_set1_epi8(0x1F);
+            for (; i + 32 <= size; i += 32) {
+                __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+                __m256i m = _mm256_or_si256(
+                    _mm256_or_si256(_mm256_cmpeq_epi8(v, quote32), _mm256_cmpeq_epi8(v, backslash32)),
+                    _mm256_cmpeq_epi8(_mm256_min_epu8(v, control32), v) // v <= 0x1F
+                );
+                if (uint32_t mask = static_cast<uint32_t>(_mm256_movemask_epi8(m)))
+                    return i + std::countr_zero(mask);
+            }
+            #endif
+
+            #if defined(DRPC_SIMD_SSE2)
+            const __m128i quote = _mm_set1_epi8('"');
+            const __m128i backslash = _mm_set1_epi8('\\');
+            const __m128i control = _mm_set1_epi8(0x1F);
+            for (; i + 16 <= size; i += 16) {
+                __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+                __m128i m = _mm_or_si128(
+                    _mm_or_si128(_mm_cmpeq_epi8(v, quote), _mm_cmpeq_epi8(v, backslash)),
+                    _mm_cmpeq_epi8(_mm_min_epu8(v, control), v) // v <= 0x1F
+                );
+                if (uint32_t mask = static_cast<uint32_t>(_mm_movemask_epi8(m)))
+                    return i + std::countr_zero(mask);
+            }
+            #elif defined(DRPC_SIMD_NEON)
+            const uint8x16_t quote = vdupq_n_u8('"');
+            const uint8x16_t backslash = vdupq_n_u8('\\');
+            const uint8x16_t control = vdupq_n_u8(0x1F);
+            for (; i + 16 <= size; i += 16) {
+                uint8x16_t v = vld1q_u8(reinterpret_cast<const uint8_t*>(data + i));
+                uint8x16_t m = vorrq_u8(vorrq_u8(vceqq_u8(v, quote), vceqq_u8(v, backslash)), vcleq_u8(v, control));
+                // Narrow every byte of the mask to a nibble
+                uint64_t mask = vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(m), 4)), 0);
+                if (mask)
+                    return i + (std::countr_zero(mask) >> 2);
+            }
+            #endif
+
+            for (; i < size; i++) {
+                if (NeedsEscape(static_cast<unsigned char>(data[i])))
+                    return i;
+            }
+            return size;
+        }
+
         template<typename T>
         concept JsonValueType = requires(T value) {
             JsonValue(value);
         };
 
+        /**
+         * @brief Describes one serialized member of Owner
+         *
+         * key is the pre-rendered "name": fragment, which is written verbatim. The member is left out
+         * of the output when skip is set and returns true for its value.
+         */
+        template<typename Owner, typename Member>
+        struct Field {
+            std::string_view key;
+            Member Owner::* member;
+            bool (*skip)(const Member& value) = nullptr;
+        };
+
+        template<typename Owner, typename Member>
+        Field(std::string_view, Member Owner::*) -> Field<Owner, Member>;
+
+        template<typename Owner, typename Member, typename Skip>
+        Field(std::string_view, Member Owner::*, Skip) -> Field<Owner, Member>;
+
+        /**
+         * @brief Types which list their members in a static constexpr JsonFields() tuple of Field
+         */
+        template<typename T>
+        concept Described = requires {
+            T::JsonFields();
+        };
+
+        template<Described T>
+        void Serialize(JsonWriter* writer, const T& object);
+
+        template<typename T, typename Writer>
+        concept JsonWritable = requires(Writer& writer, const T& value) {
+            writer.Write(value);
+        };
+
         class JsonWriter {
         public:
-        void BeginObject() {
+            JsonWriter() = default;
+
+            /**
+             * @param capacity Number of bytes to allocate up front
+             */
+            explicit JsonWriter(size_t capacity) {
+                buffer.reserve(capacity);
+            }
+
+            void BeginObject() {
                 WriteRaw("{");
-                current_object_sizes.emplace_back(0);
+                scope_sizes.emplace_back(0);
             }
 
             void EndObject() {
                 WriteRaw("}");
-                current_object_sizes.pop_back();
+                scope_sizes.pop_back();
+            }
+
+            void BeginArray() {
+                WriteRaw("[");
+                scope_sizes.emplace_back(0);
             }
 
-            std::string ToString() const {
-                return s.str();
+            void EndArray() {
+                WriteRaw("]");
+                scope_sizes.pop_back();
+            }
+
+            /**
+             * @brief Discards the written output but keeps the allocated capacity
+             */
+            void Reset() {
+                buffer.clear();
+                scope_sizes.clear();
+            }
+
+            /**
+             * @brief Returns a view of the written output which is valid until the next write or Reset
+             */
+            std::string_view View() const {
+                return buffer;
+            }
+
+            /**
+             * @brief Moves the written output out of the writer, leaving it empty
+             */
+            std::string Release() {
+                std::string result = std::move(buffer);
+                Reset();
+                return result;
             }
 
             void Write(const JsonSerializable& object) {
                 object.ToJson(this);
             }
 
-            void Write(const JsonValue value) {
+            /**
+             * @brief Uses the type's own ToJson if it has one, which may write from a cache
+             */
+            template<Described T>
+            void Write(const T& object) {
+                if constexpr (requires { object.ToJson(this); })
+                    object.ToJson(this);
+                else
+                    Serialize(this, object);
+            }
+
+            template<std::ranges::input_range R> requires (!std::is_convertible_v<const R&, std::string_view>)
+            void Write(const R& range) {
+                BeginArray();
+                for (const auto& item : range)
+                    Append(item);
+                EndArray();
+            }
+
+            template<typename T> requires std::is_enum_v<T>
+            void Write(T value) {
+                WriteNumber(std::to_underlying(value));
+            }
+
+            template<typename T>
+            void Write(const std::shared_ptr<T>& object) {
+                if (object != nullptr)
+                    Write(*object);
+                else
+                    WriteRaw("null");
+            }
+
+            void Write(const JsonValue& value) {
                 value.ToJson(this);
             }
-            
-            void WriteRaw(const char* str) {
-                s.write(str, strlen(str));
+
+            void Write(std::nullptr_t) {
+                WriteRaw("null");
             }
 
-            void PendMember(const char* key) {
-                assert(current_object_sizes.size() > 0);
+            void Write(std::string_view str) {
+                WriteString(str);
+            }
 
-                if (current_object_sizes.back() > 0)
-                    WriteRaw(",");
+            void Write(const std::string& str) {
+                WriteString(str);
+            }
 
-                Write(key);
-                WriteRaw(":");
-                current_object_sizes.back()++;
+            void Write(const char* str) {
+                WriteString(str);
             }
 
-            template<JsonValueType T>
-            void Put(const std::string& key, T value) {
-                assert(current_object_sizes.size() > 0);
+            template<typename T> requires std::is_arithmetic_v<T>
+            void Write(T value) {
+                if constexpr (std::is_same_v<T, bool>)
+                    WriteRaw(value ? "true" : "false");
+                else
+                    WriteNumber(value);
+            }
 
-                if (current_object_sizes.back() > 0)
-                    WriteRaw(",");
+            void WriteRaw(std::string_view str) {
+                buffer.append(str);
+            }
 
-                Write(key);
-                WriteRaw(":");
-                Write(JsonValue(value));
-                current_object_sizes.back()++;
+            /**
+             * @brief Writes str as a quoted JSON string, escaping quotes, backslashes and control characters
+             */
+            void WriteString(std::string_view str) {
+                buffer.reserve(buffer.size() + str.size() + 2);
+                buffer.push_back('"');
+                WriteEscaped(str);
+                buffer.push_back('"');
             }
-        private:
-            std::stringstream s;
-            std::vector<size_t> current_object_sizes;
-        };
 
-        inline void JsonValue::ToJson(JsonWriter* writer) const {
-            if (std::holds_alternative<std::string>(value)) {
-                writer->WriteRaw("\"");
-                writer->WriteRaw(std::get<std::string>(value).c_str());
-                writer->WriteRaw("\"");
-            } else if (std::holds_alternative<int32_t>(value)) {
-                writer->WriteRaw(std::to_string(std::get<int32_t>(value)).c_str());
-            } else if (std::holds_alternative<uint32_t>(value)) {
-                writer->WriteRaw(std::to_string(std::get<uint32_t>(value)).c_str());
-            } else if (std::holds_alternative<int64_t>(value)) {
-                writer->WriteRaw(std::to_string(std::get<int64_t>(value)).c_str());
-            } else if (std::holds_alternative<uint64_t>(value)) {
-                writer->WriteRaw(std::to_string(std::get<uint64_t>(value)).c_str());
-            } else if (std::holds_alternative<float>(value)) {
-                writer->WriteRaw(std::to_string(std::get<float>(value)).c_str());
-            } else if (std::holds_alternative<double>(value)) {
-                writer->WriteRaw(std::to_string(std::get<double>(value)).c_str());
-            } else if (std::holds_alternative<bool>(value)) {
-                writer->WriteRaw(std::get<bool>(value) ? "true" : "false");
-            } else if (std::holds_alternative<std::shared_ptr<JsonSerializable>>(value)){
-                auto s = std::get<std::shared_ptr<JsonSerializable>>(value);
-                s->ToJson(writer);
-            } else if (std::holds_alternative<std::vector<JsonValue>>(value)) {
-                writer->WriteRaw("[");
-
-                auto items = std::get<std::vector<JsonValue>>(value);
-                for (size_t i = 0; i < items.size(); i++) {
-                    items[i].ToJson(writer);
-                    if (i + 1 < items.size())
-                        writer->WriteRaw(",");
+            /**
+             * @brief Writes the inside of a JSON string without the quotes
+             */
+            void WriteEscaped(std::string_view str) {
+                static constexpr char hex_digits[] = "0123456789abcdef";
+
+                while (!str.empty()) {
+                    size_t clean = FindEscape(str);
+                    buffer.append(str.data(), clean);
+                    if (clean == str.size())
+                        break;
+
+                    unsigned char c = static_cast<unsigned char>(str[clean]);
+                    switch (c) {
+                    case '"': WriteRaw("\\\""); break;
+                    case '\\': WriteRaw("\\\\"); break;
+                    case '\b': WriteRaw("\\b"); break;
+                    case '\f': WriteRaw("\\f"); break;
+                    case '\n': WriteRaw("\\n"); break;
+                    case '\r': WriteRaw("\\r"); break;
+                    case '\t': WriteRaw("\\t"); break;
+                    default: {
+                        const char escaped[] = { '\\', 'u', '0', '0', hex_digits[c >> 4], hex_digits[c & 0xF] };
+                        WriteRaw(std::string_view(escaped, sizeof(escaped)));
+                        break;
+                    }
+                    }
+
+                    str.remove_prefix(clean + 1);
+                }
+            }
+
+            /**
+             * @brief Writes a number directly into the output. Floating point values use the shortest
+             * representation which round-trips; NaN and infinity are written as null
+             */
+            template<typename T> requires std::is_arithmetic_v<T> && (!std::is_same_v<T, bool>)
+            void WriteNumber(T n) {
+                if constexpr (std::is_floating_point_v<T>) {
+                    if (!std::isfinite(n)) {
+                        WriteRaw("null");
+                        return;
+                    }
                 }
 
-                writer->WriteRaw("]");
-            } else if (std::holds_alternative<std::map<std::string, JsonValue>>(value)) {
-                writer->WriteRaw("{");
+                // 32 bytes fit any 64-bit integer and the shortest form of any double
+                size_t offset = buffer.size();
+                buffer.resize(offset + 32);
+                auto [end, ec] = std::to_chars(buffer.data() + offset, buffer.data() + buffer.size(), n);
+                assert(ec == std::errc());
+                buffer.resize(end - buffer.data());
+            }
+
+            void PendMember(std::string_view key) {
+                assert(scope_sizes.size() > 0);
 
-                for (auto const& [key, value] : std::get<std::map<std::string, JsonValue>>(value))
-                    writer->Put(key, value);
+                if (scope_sizes.back() > 0)
+                    WriteRaw(",");
 
-                writer->WriteRaw("}");
+                WriteKey(key);
+                scope_sizes.back()++;
             }
-        }
-    }
 
-    namespace UUID {
-        inline std::string GenerateUUIDv4() {
-            static std::random_device rd;
-            static std::mt19937 mt(rd());
-            static std::uniform_int_distribution<int> distribution(0, 15);
-            const auto get_digit = [] {
-                int value = distribution(mt);
-                if (value < 10) return '0' + value;
-                return 'a' + (value - 10);
-            };
+            /**
+             * @brief Like PendMember, but writes a pre-rendered "key": fragment as is
+             */
+            void PendMemberRaw(std::string_view fragment) {
+                assert(scope_sizes.size() > 0);
 
-            std::string result;
+                if (scope_sizes.back() > 0)
+                    WriteRaw(",");
 
-            for (int i = 0; i < 8; i++) result += get_digit();
-            result += '-';
-            for (int i = 0; i < 4; i++) result += get_digit();
-            result += "-4"; // version
-            for (int i = 0; i < 3; i++) result += get_digit();
-            result += '-';
-            for (int i = 0; i < 4; i++) result += get_digit();
-            result += '-';
-            for (int i = 0; i < 12; i++) result += get_digit();
+                WriteRaw(fragment);
+                scope_sizes.back()++;
+            }
 
-            return result;
-        }
-    }
+            template<typename T> requires JsonWritable<T, JsonWriter>
+            void Put(std::string_view key, const T& value) {
+                PendMember(key);
+                Write(value);
+            }
 
-    enum class Result {
-        Ok = 0,
-        PipeNotOpen,
-        OpenPipeFailed,
-        ReadPipeFailed,
-        WritePipeFailed,
-        HandshakeFailed,
-        SetActivityFailed,
-        UnknownError,
-        ReadPipeNoData
-    };
+            /**
+             * @brief Writes an element of the array opened by BeginArray
+             */
+            template<typename T> requires JsonWritable<T, JsonWriter>
+            void Append(const T& value) {
+                assert(scope_sizes.size() > 0);
 
-    enum class LogLevel {
-        Info,
-        Warn,
-        Error,
-        Trace
-    };
+                if (scope_sizes.back() > 0)
+                    WriteRaw(",");
 
-    enum class Event {
-        Connected,
-        Disconnected
-    };
+                Write(value);
+                scope_sizes.back()++;
+            }
+        protected:
+            std::string buffer;
+        private:
+            void WriteKey(std::string_view key) {
+                WriteString(key);
+                WriteRaw(":");
+            }
 
-    inline const char* ResultToString(Result result) {
-        switch (result) {
-        case DiscordRichPresence::Result::Ok:
-            return "Ok";
-        case DiscordRichPresence::Result::PipeNotOpen:
-            return "PipeNotOpen";
-        case DiscordRichPresence::Result::OpenPipeFailed:
-            return "OpenPipeFailed";
-        case DiscordRichPresence::Result::ReadPipeFailed:
-            return "ReadPipeFailed";
-        case DiscordRichPresence::Result::WritePipeFailed:
-            return "WritePipeFailed";
-        case DiscordRichPresence::Result::HandshakeFailed:
-            return "HandshakeFailed";
-        case DiscordRichPresence::Result::SetActivityFailed:
-            return "SetActivity";
-        case DiscordRichPresence::Result::UnknownError:
-            return "UnknownError";
-        case DiscordRichPresence::Result::ReadPipeNoData:
-            return "ReadPipeNoData";
-        }
-    }
+            std::vector<size_t> scope_sizes;
+        };
 
-    inline const char* ResultToDescription(Result result) {
-        switch (result) {
-        case DiscordRichPresence::Result::Ok:
-            return "Ok";
-        case DiscordRichPresence::Result::PipeNotOpen:
-            return "Named pipe is not open";
-        case DiscordRichPresence::Result::OpenPipeFailed:
-            return "Failed to open named pipe";
-        case DiscordRichPresence::Result::ReadPipeFailed:
-            return "Failed to read from named pipe";
-        case DiscordRichPresence::Result::WritePipeFailed:
-            return "Failed to write to named pipe";
-        case DiscordRichPresence::Result::HandshakeFailed:
-            return "Failed to handshake with Discord client";
-        case DiscordRichPresence::Result::SetActivityFailed:
-            return "Failed to set Discord activity";
-        case DiscordRichPresence::Result::UnknownError:
-            return "An unknown occured";
-        case DiscordRichPresence::Result::ReadPipeNoData:
-            return "Reading from named pipe returned no data";
+        inline void JsonValue::ToJson(JsonWriter* writer) const {
+            Visit([writer](const auto& value) {
+                using T = std::decay_t<decltype(value)>;
+
+                if constexpr (std::is_same_v<T, std::span<const JsonValue>>) {
+                    writer->BeginArray();
+                    for (const auto& item : value)
+                        writer->Append(item);
+                    writer->EndArray();
+                } else if constexpr (std::is_same_v<T, std::span<const JsonMember>>) {
+                    writer->BeginObject();
+                    for (const auto& member : value)
+                        writer->Put(member.key.GetString(), member.value);
+                    writer->EndObject();
+                } else {
+                    writer->Write(value);
+                }
+            });
         }
     }
 
-    struct IpcMessage {
-        uint32_t op_code;
-        std::string message;
-        std::string nonce;
-    };
-
-    class Pipe {
-    public:
-        virtual Result Open() = 0;
-        virtual Result Close() = 0;
-        virtual Result Read(IpcMessage* message, bool peek = false) = 0;
-        virtual void CancelIo() = 0;
-        virtual Result Write(uint32_t op_code, std::string message) = 0;
-        virtual bool IsOpen() = 0;
-    };
+    namespace JSON {
+        template<Described T>
+        void Serialize(JsonWriter* writer, const T& object) {
+            constexpr auto fields = T::JsonFields();
 
-    #ifdef _WIN32
-    class WindowsPipe final : public Pipe {
-    public:
-        ~WindowsPipe() {
-            Close();
+            writer->BeginObject();
+            std::apply([&](const auto&... field) {
+                const auto write_field = [&](const auto& field) {
+                    const auto& value = object.*field.member;
+                    if (field.skip != nullptr && field.skip(value))
+                        return;
+
+                    writer->PendMemberRaw(field.key);
+                    writer->Write(value);
+                };
+                (write_field(field), ...);
+            }, fields);
+            writer->EndObject();
         }
-        
-        Result Open() override {
-            if (pipe_handle) return Result::Ok;
 
-            // Create pipe handle
-            HANDLE pipe = CreateFileA(
-                "\\\\.\\pipe\\discord-ipc-0",
-                GENERIC_READ | GENERIC_WRITE,
-                NULL,
-                NULL,
-                OPEN_EXISTING,
-                NULL,
-                NULL
-            );
+        enum class TokenType : uint8_t {
+            BeginObject,
+            EndObject,
+            BeginArray,
+            EndArray,
+            String,
+            Number,
+            True,
+            False,
+            Null,
+            End,
+            Error
+        };
 
-            if (pipe != INVALID_HANDLE_VALUE) {
-                pipe_handle = pipe;
+        /**
+         * @param text For strings the characters between the quotes, still escaped
+         */
+        struct Token {
+            TokenType type;
+            std::string_view text;
+        };
 
-                DWORD mode = PIPE_READMODE_BYTE;
-                if (!SetNamedPipeHandleState(pipe, &mode, NULL, NULL)) {
-                    Close();
-                    return Result::OpenPipeFailed;
+        /**
+         * @brief A pull tokenizer over a JSON document. It never allocates; tokens are views into the document.
+         * Commas and colons are consumed between tokens and not reported.
+         */
+        class JsonReader {
+        public:
+            explicit JsonReader(std::string_view json) : json(json) {}
+
+            Token Next() {
+                while (position < json.size()) {
+                    char c = json[position];
+                    if (c != ' ' && c != '\t' && c != '\n' && c != '\r' && c != ',' && c != ':')
+                        break;
+                    position++;
+                }
+
+                if (position >= json.size())
+                    return { TokenType::End, {} };
+
+                size_t start = position++;
+                switch (json[start]) {
+                case '{': return { TokenType::BeginObject, json.substr(start, 1) };
+                case '}': return { TokenType::EndObject, json.substr(start, 1) };
+                case '[': return { TokenType::BeginArray, json.substr(start, 1) };
+                case ']': return { TokenType::EndArray, json.substr(start, 1) };
+                case '"':
+                    while ((position = json.find_first_of("\"\\", position)) != std::string_view::npos) {
+                        if (json[position] == '\\') {
+                            position += 2;
+                            continue;
+                        }
+
+                        position++;
+                        return { TokenType::String, json.substr(start + 1, position - start - 2) };
+                    }
+                    position = json.size();
+                    return { TokenType::Error, {} };
+                case 't': return Literal(start, "true", TokenType::True);
+                case 'f': return Literal(start, "false", TokenType::False);
+                case 'n': return Literal(start, "null", TokenType::Null);
+                default:
+                    if (json[start] != '-' && (json[start] < '0' || json[start] > '9'))
+                        return { TokenType::Error, {} };
+
+                    position = std::min(json.find_first_not_of("+-.eE0123456789", start), json.size());
+                    return { TokenType::Number, json.substr(start, position - start) };
                 }
-            } else {
-                return Result::OpenPipeFailed;
             }
 
-            return Result::Ok;
-        }
+            /**
+             * @brief Skips over the value which begins with first
+             * @return The raw JSON of the value, or an empty view if the document ends early
+             */
+            std::string_view SkipValue(const Token& first) {
+                const char* begin = first.type == TokenType::String ? first.text.data() - 1 : first.text.data();
+
+                if (first.type == TokenType::BeginObject || first.type == TokenType::BeginArray) {
+                    size_t depth = 1;
+                    while (depth > 0) {
+                        Token token = Next();
+                        if (token.type == TokenType::End || token.type == TokenType::Error)
+                            return {};
+                        if (token.type == TokenType::BeginObject || token.type == TokenType::BeginArray)
+                            depth++;
+                        else if (token.type == TokenType::EndObject || token.type == TokenType::EndArray)
+                            depth--;
+                    }
+                }
 
-        Result Close() override {
-            CloseHandle(pipe_handle);
-            pipe_handle = NULL;
-            return Result::Ok;
-        }
+                return { begin, static_cast<size_t>(json.data() + position - begin) };
+            }
+        private:
+            Token Literal(size_t start, std::string_view literal, TokenType type) {
+                if (json.substr(start, literal.size()) != literal)
+                    return { TokenType::Error, {} };
 
-        template<size_t N>
-        Result ReadBytes(std::array<std::byte, N>* buffer, bool peek = false) {
-            DWORD bytes_read;
-            if (peek) {
-                DWORD bytes_available;
-                if (PeekNamedPipe(pipe_handle, NULL, NULL, NULL, &bytes_available, NULL)) {
-                    if (bytes_available > 0)
-                        goto read;
-                    else
-                        return Result::ReadPipeNoData;
+                position = start + literal.size();
+                return { type, json.substr(start, literal.size()) };
+            }
+
+            std::string_view json;
+            size_t position = 0;
+        };
+
+        /**
+         * @brief Appends the decoded form of an escaped JSON string to out
+         */
+        inline void Unescape(std::string_view escaped, std::string* out) {
+            const auto append_utf8 = [out](uint32_t code_point) {
+                if (code_point < 0x80) {
+                    out->push_back(static_cast<char>(code_point));
+                } else if (code_point < 0x800) {
+                    out->push_back(static_cast<char>(0xC0 | (code_point >> 6)));
+                    out->push_back(static_cast<char>(0x80 | (code_point & 0x3F)));
+                } else if (code_point < 0x10000) {
+                    out->push_back(static_cast<char>(0xE0 | (code_point >> 12)));
+                    out->push_back(static_cast<char>(0x80 | ((code_point >> 6) & 0x3F)));
+                    out->push_back(static_cast<char>(0x80 | (code_point & 0x3F)));
+                } else {
+                    out->push_back(static_cast<char>(0xF0 | (code_point >> 18)));
+                    out->push_back(static_cast<char>(0x80 | ((code_point >> 12) & 0x3F)));
+                    out->push_back(static_cast<char>(0x80 | ((code_point >> 6) & 0x3F)));
+                    out->push_back(static_cast<char>(0x80 | (code_point & 0x3F)));
                 }
-                return Result::ReadPipeFailed;
-            } else {
-                read:
-                if (!ReadFile(pipe_handle, buffer->data(), buffer->size(), &bytes_read, 0)
-                    || bytes_read != buffer->size()) {
-                    return Result::ReadPipeFailed;
+            };
+            const auto read_hex = [&escaped](size_t at) -> uint32_t {
+                uint32_t value = 0;
+                if (at + 4 > escaped.size() || std::from_chars(escaped.data() + at, escaped.data() + at + 4, value, 16).ptr != escaped.data() + at + 4)
+                    return 0xFFFD;
+                return value;
+            };
+
+            for (size_t i = 0; i < escaped.size(); i++) {
+                if (escaped[i] != '\\' || i + 1 >= escaped.size()) {
+                    out->push_back(escaped[i]);
+                    continue;
+                }
+
+                switch (escaped[++i]) {
+                case 'b': out->push_back('\b'); break;
+                case 'f': out->push_back('\f'); break;
+                case 'n': out->push_back('\n'); break;
+                case 'r': out->push_back('\r'); break;
+                case 't': out->push_back('\t'); break;
+                case 'u': {
+                    uint32_t code_point = read_hex(i + 1);
+                    i += 4;
+                    // Combine surrogate pairs
+                    if (code_point >= 0xD800 && code_point < 0xDC00 && i + 2 < escaped.size()
+                        && escaped[i + 1] == '\\' && escaped[i + 2] == 'u') {
+                        uint32_t low = read_hex(i + 3);
+                        if (low >= 0xDC00 && low < 0xE000) {
+                            code_point = 0x10000 + ((code_point - 0xD800) << 10) + (low - 0xDC00);
+                            i += 6;
+                        }
+                    }
+                    append_utf8(code_point);
+                    break;
+                }
+                default: out->push_back(escaped[i]); break; // " \ /
                 }
             }
-            return Result::Ok;
         }
 
-        Result Read(IpcMessage* message, bool peek) override {
-            static std::regex nonce_re(R"(\"nonce\":\"([a-zA-Z0-9\-]+)\")");
+        /**
+         * @brief A flat index over every value of a JSON document, built in a single pass
+         *
+         * Nodes are stored in document order and object members as key node followed by value node, so
+         * lookups can hop over whole subtrees. Positions are offsets, which keeps an index valid for every
+         * copy of the document it was built from.
+         */
+        class JsonIndex {
+        public:
+            static constexpr size_t npos = static_cast<size_t>(-1);
+
+            struct Node {
+                TokenType type;
+                bool decoded; // text lives in the index instead of the document
+                uint32_t offset;
+                uint32_t length;
+                uint32_t next; // first node after this value and its children
+            };
 
-            std::array<std::byte, 4> op_code_bytes, msg_len_bytes;
+            /**
+             * @param json The document
+             * @param base Offset of json within the string later passed to Text
+             */
+            JsonIndex(std::string_view json, size_t base = 0) {
+                JsonReader reader(json);
+                std::vector<size_t> open;
+                decoded.reserve(json.size());
+
+                while (true) {
+                    Token token = reader.Next();
+                    if (token.type == TokenType::End || token.type == TokenType::Error)
+                        break;
+
+                    if (token.type == TokenType::EndObject || token.type == TokenType::EndArray) {
+                        if (open.empty())
+                            break;
+                        nodes[open.back()].next = static_cast<uint32_t>(nodes.size());
+                        open.pop_back();
+                        if (open.empty())
+                            break;
+                        continue;
+                    }
 
-            Result result;
-            if (result = ReadBytes(&op_code_bytes, peek); result != Result::Ok) return result;
-            if (result = ReadBytes(&msg_len_bytes, peek); result != Result::Ok) return result;
+                    Node node {
+                        .type = token.type,
+                        .decoded = false,
+                        .offset = static_cast<uint32_t>(base + (token.text.data() - json.data())),
+                        .length = static_cast<uint32_t>(token.text.size()),
+                        .next = static_cast<uint32_t>(nodes.size() + 1)
+                    };
+
+                    if (token.type == TokenType::String && token.text.find('\\') != std::string_view::npos) {
+                        node.decoded = true;
+                        node.offset = static_cast<uint32_t>(decoded.size());
+                        Unescape(token.text, &decoded);
+                        node.length = static_cast<uint32_t>(decoded.size() - node.offset);
+                    }
 
-            message->op_code = std::bit_cast<uint32_t>(op_code_bytes);
-            uint32_t msg_len = std::bit_cast<uint32_t>(msg_len_bytes);
-            
-            std::vector<char> buffer(msg_len);
-            DWORD bytes_read;
+                    nodes.push_back(node);
+                    if (token.type == TokenType::BeginObject || token.type == TokenType::BeginArray)
+                        open.push_back(nodes.size() - 1);
+                    else if (open.empty())
+                        break; // a scalar document
+                }
 
-            if (peek) {
-                DWORD bytes_available;
-                if (PeekNamedPipe(pipe_handle, NULL, NULL, NULL, &bytes_available, NULL)) {
-                    if (bytes_available > 0)
-                        goto read;
-                    else
-                        return Result::ReadPipeNoData;
-                } else {
-                    return Result::ReadPipeFailed;
+                // Close subtrees of a truncated document
+                for (size_t node : open)
+                    nodes[node].next = static_cast<uint32_t>(nodes.size());
+            }
+
+            size_t Size() const {
+                return nodes.size();
+            }
+
+            const Node& At(size_t node) const {
+                return nodes[node];
+            }
+
+            /**
+             * @brief Looks up a member of the object at node
+             * @return The value node, or npos
+             */
+            size_t Find(std::string_view document, size_t node, std::string_view key) const {
+                if (node >= nodes.size() || nodes[node].type != TokenType::BeginObject)
+                    return npos;
+
+                for (size_t i = node + 1; i + 1 < nodes[node].next; i = nodes[i + 1].next) {
+                    if (Text(document, i) == key)
+                        return i + 1;
                 }
-            } else {
-                read:
-                if (!ReadFile(pipe_handle, buffer.data(), msg_len, &bytes_read, 0) || bytes_read != msg_len) {
-                    return Result::ReadPipeFailed;
+                return npos;
+            }
+
+            /**
+             * @brief Follows a path of object keys from the root
+             */
+            size_t Find(std::string_view document, std::initializer_list<std::string_view> path) const {
+                size_t node = nodes.empty() ? npos : 0;
+                for (auto key : path) {
+                    if (node == npos) break;
+                    node = Find(document, node, key);
                 }
+                return node;
             }
-            message->message = std::string(buffer.begin(), buffer.end());
-            
-            // Get nonce
-            std::smatch match;
-            if (std::regex_search(message->message, match, nonce_re))
-                message->nonce = match.str(1);
 
-            return Result::Ok;
+            /**
+             * @brief The decoded contents of a string node or the raw text of a scalar
+             */
+            std::string_view Text(std::string_view document, size_t node) const {
+                if (node >= nodes.size())
+                    return {};
+
+                const Node& n = nodes[node];
+                return (n.decoded ? std::string_view(decoded) : document).substr(n.offset, n.length);
+            }
+
+            /**
+             * @brief The decoded contents of a string node; empty for any other node, including null
+             */
+            std::string_view String(std::string_view document, size_t node) const {
+                if (node >= nodes.size() || nodes[node].type != TokenType::String)
+                    return {};
+                return Text(document, node);
+            }
+
+            template<typename T> requires std::is_arithmetic_v<T>
+            std::optional<T> Number(std::string_view document, size_t node) const {
+                if (node >= nodes.size() || nodes[node].type != TokenType::Number)
+                    return std::nullopt;
+
+                auto text = Text(document, node);
+                T value;
+                if (std::from_chars(text.data(), text.data() + text.size(), value).ec != std::errc())
+                    return std::nullopt;
+                return value;
+            }
+        private:
+            std::vector<Node> nodes;
+            std::string decoded;
+        };
+    }
+
+    namespace UUID {
+        /**
+         * @brief A UUID in its 36 character text form
+         */
+        struct Uuid {
+            std::array<char, 36> chars;
+
+            std::string_view View() const {
+                return std::string_view(chars.data(), chars.size());
+            }
+        };
+
+        /**
+         * @brief Writes 16 bytes as 32 lowercase hex digits
+         */
+        inline void EncodeHex(const uint8_t* bytes, char* out) {
+            #if defined(DRPC_SIMD_SSE2)
+            const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(bytes));
+            const __m128i low_nibble = _mm_set1_epi8(0x0F);
+            const auto to_ascii = [](__m128i n) {
+                __m128i letter = _mm_cmpgt_epi8(n, _mm_set1_epi8(9));
+                return _mm_add_epi8(_mm_add_epi8(n, _mm_set1_epi8('0')), _mm_and_si128(letter, _mm_set1_epi8('a' - '0' - 10)));
+            };
+
+            __m128i high = _mm_and_si128(_mm_srli_epi16(v, 4), low_nibble);
+            __m128i low = _mm_and_si128(v, low_nibble);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out), to_ascii(_mm_unpacklo_epi8(high, low)));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 16), to_ascii(_mm_unpackhi_epi8(high, low)));
+            #elif defined(DRPC_SIMD_NEON)
+            const uint8x16_t v = vld1q_u8(bytes);
+            const auto to_ascii = [](uint8x16_t n) {
+                uint8x16_t letter = vcgtq_u8(n, vdupq_n_u8(9));
+                return vaddq_u8(vaddq_u8(n, vdupq_n_u8('0')), vandq_u8(letter, vdupq_n_u8('a' - '0' - 10)));
+            };
+
+            uint8x16x2_t digits = vzipq_u8(vshrq_n_u8(v, 4), vandq_u8(v, vdupq_n_u8(0x0F)));
+            vst1q_u8(reinterpret_cast<uint8_t*>(out), to_ascii(digits.val[0]));
+            vst1q_u8(reinterpret_cast<uint8_t*>(out + 16), to_ascii(digits.val[1]));
+            #else
+            static constexpr char hex_digits[] = "0123456789abcdef";
+            for (int i = 0; i < 16; i++) {
+                out[i * 2] = hex_digits[bytes[i] >> 4];
+                out[i * 2 + 1] = hex_digits[bytes[i] & 0x0F];
+            }
+            #endif
         }
 
-        void CancelIo() override {
-            ::CancelIo(pipe_handle);
+        /**
+         * @brief splitmix64 over a thread local state, seeded once per thread
+         */
+        inline uint64_t NextRandom() {
+            thread_local uint64_t state = [] {
+                std::random_device rd;
+                uint64_t seed = (static_cast<uint64_t>(rd()) << 32) ^ rd();
+                // Keep threads apart even where random_device is deterministic
+                seed ^= std::hash<std::thread::id>()(std::this_thread::get_id());
+                seed ^= static_cast<uint64_t>(std::chrono::steady_clock::now().time_since_epoch().count());
+                return seed;
+            }();
+
+            uint64_t z = (state += 0x9e3779b97f4a7c15);
+            z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+            z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+            return z ^ (z >> 31);
         }
 
-        Result Write(uint32_t op_code, std::string message) override {
-            uint32_t length = static_cast<uint32_t>(message.length());
+        /**
+         * @brief Formats 16 bytes as xxxxxxxx-xxxx-xxxx-xxxx-xxxxxxxxxxxx
+         */
+        inline Uuid Format(const std::array<uint8_t, 16>& bytes) {
+            char hex[32];
+            EncodeHex(bytes.data(), hex);
+
+            Uuid uuid;
+            char* out = uuid.chars.data();
+            std::memcpy(out, hex, 8);
+            out[8] = '-';
+            std::memcpy(out + 9, hex + 8, 4);
+            out[13] = '-';
+            std::memcpy(out + 14, hex + 12, 4);
+            out[18] = '-';
+            std::memcpy(out + 19, hex + 16, 4);
+            out[23] = '-';
+            std::memcpy(out + 24, hex + 20, 12);
+            return uuid;
+        }
 
-            std::vector<char> buffer(8 + length);
-            std::memcpy(buffer.data(), &op_code, 4);
-            std::memcpy(buffer.data() + 4, &length, 4);
-            std::memcpy(buffer.data() + 8, message.data(), length);
+        /**
+         * @brief Generates a random (version 4) UUID. Thread-safe and allocation-free.
+         */
+        inline Uuid GenerateUUIDv4() {
+            std::array<uint8_t, 16> bytes;
+            uint64_t high = NextRandom(), low = NextRandom();
+            std::memcpy(bytes.data(), &high, 8);
+            std::memcpy(bytes.data() + 8, &low, 8);
+
+            bytes[6] = (bytes[6] & 0x0F) | 0x40; // version 4
+            bytes[8] = (bytes[8] & 0x3F) | 0x80; // RFC 4122 variant
+            return Format(bytes);
+        }
 
-            DWORD bytes_written;
-            return WriteFile(
-                pipe_handle,
-                buffer.data(),
-                static_cast<DWORD>(buffer.size()),
-                &bytes_written, 0
-            ) && bytes_written == buffer.size() ? Result::Ok : Result::WritePipeFailed;
+        /**
+         * @brief Builds a nonce whose first half is the random prefix and whose last 64 bits carry id
+         */
+        inline Uuid EncodeId(uint64_t prefix, uint64_t id) {
+            std::array<uint8_t, 16> bytes;
+            for (int i = 0; i < 8; i++) {
+                bytes[i] = static_cast<uint8_t>(prefix >> (56 - i * 8));
+                bytes[8 + i] = static_cast<uint8_t>(id >> (56 - i * 8));
+            }
+            bytes[6] = (bytes[6] & 0x0F) | 0x40;
+            return Format(bytes);
         }
 
-        bool IsOpen() override {
-            return pipe_handle && GetNamedPipeHandleState(pipe_handle, NULL, NULL, NULL, NULL, NULL, 0);
+        /**
+         * @brief Recovers the id from a nonce made by EncodeId with the same prefix
+         * @return std::nullopt if the nonce was not made with this prefix
+         */
+        inline std::optional<uint64_t> DecodeId(uint64_t prefix, std::string_view nonce) {
+            // xxxxxxxx-xxxx-4xxx-IIII-IIIIIIIIIIII
+            static constexpr size_t prefix_length = 19;
+            if (nonce.size() != 36 || nonce.substr(0, prefix_length) != EncodeId(prefix, 0).View().substr(0, prefix_length) || nonce[23] != '-')
+                return std::nullopt;
+
+            uint64_t high = 0, low = 0;
+            auto high_result = std::from_chars(nonce.data() + 19, nonce.data() + 23, high, 16);
+            auto low_result = std::from_chars(nonce.data() + 24, nonce.data() + 36, low, 16);
+            if (high_result.ptr != nonce.data() + 23 || low_result.ptr != nonce.data() + 36)
+                return std::nullopt;
+
+            return (high << 48) | low;
         }
-    private:
-        HANDLE pipe_handle;
+    }
+
+    enum class Result {
+        Ok = 0,
+        PipeNotOpen,
+        OpenPipeFailed,
+        ReadPipeFailed,
+        WritePipeFailed,
+        HandshakeFailed,
+        SetActivityFailed,
+        UnknownError,
+        ReadPipeNoData,
+        QueueFull,
+        Superseded
     };
 
-    #else
+    enum class LogLevel {
+        Info,
+        Warn,
+        Error,
+        Trace
+    };
 
-    class UnixPipe : public Pipe {
-      public:
-        Result Open() override {
-          socketfd = socket(AF_UNIX, SOCK_STREAM, 0);
-          if (socketfd < 0)
-            return Result::OpenPipeFailed;
+    enum class Event {
+        Connected,
+        Disconnected
+    };
 
-          struct sockaddr_un addr;
-          memset(&addr, 0, sizeof(addr));
-          addr.sun_family = AF_UNIX;
-          strcpy(addr.sun_path, "/var/run/user/1000/discord-ipc-0");
+    inline const char* ResultToString(Result result) {
+        switch (result) {
+        case DiscordRichPresence::Result::Ok:
+            return "Ok";
+        case DiscordRichPresence::Result::PipeNotOpen:
+            return "PipeNotOpen";
+        case DiscordRichPresence::Result::OpenPipeFailed:
+            return "OpenPipeFailed";
+        case DiscordRichPresence::Result::ReadPipeFailed:
+            return "ReadPipeFailed";
+        case DiscordRichPresence::Result::WritePipeFailed:
+            return "WritePipeFailed";
+        case DiscordRichPresence::Result::HandshakeFailed:
+            return "HandshakeFailed";
+        case DiscordRichPresence::Result::SetActivityFailed:
+            return "SetActivity";
+        case DiscordRichPresence::Result::UnknownError:
+            return "UnknownError";
+        case DiscordRichPresence::Result::ReadPipeNoData:
+            return "ReadPipeNoData";
+        case DiscordRichPresence::Result::QueueFull:
+            return "QueueFull";
+        case DiscordRichPresence::Result::Superseded:
+            return "Superseded";
+        }
+    }
+
+    inline const char* ResultToDescription(Result result) {
+        switch (result) {
+        case DiscordRichPresence::Result::Ok:
+            return "Ok";
+        case DiscordRichPresence::Result::PipeNotOpen:
+            return "Named pipe is not open";
+        case DiscordRichPresence::Result::OpenPipeFailed:
+            return "Failed to open named pipe";
+        case DiscordRichPresence::Result::ReadPipeFailed:
+            return "Failed to read from named pipe";
+        case DiscordRichPresence::Result::WritePipeFailed:
+            return "Failed to write to named pipe";
+        case DiscordRichPresence::Result::HandshakeFailed:
+            return "Failed to handshake with Discord client";
+        case DiscordRichPresence::Result::SetActivityFailed:
+            return "Failed to set Discord activity";
+        case DiscordRichPresence::Result::UnknownError:
+            return "An unknown occured";
+        case DiscordRichPresence::Result::ReadPipeNoData:
+            return "Reading from named pipe returned no data";
+        case DiscordRichPresence::Result::QueueFull:
+            return "Too many requests are waiting to be sent";
+        case DiscordRichPresence::Result::Superseded:
+            return "A newer update replaced this one while it waited for the rate limit";
+        }
+    }
+
+    /**
+     * @brief Fields of the READY dispatch which answers the handshake. Views into the message.
+     */
+    struct ReadyData {
+        int version = 0;
+
+        struct {
+            std::string_view id;
+            std::string_view username;
+            std::string_view discriminator;
+            std::string_view global_name;
+            std::string_view avatar;
+        } user;
+
+        struct {
+            std::string_view cdn_host;
+            std::string_view api_endpoint;
+            std::string_view environment;
+        } config;
+    };
 
-          if (connect(socketfd, (struct sockaddr*)&addr, sizeof(addr)) == -1)
-            return Result::OpenPipeFailed;
+    /**
+     * @brief Fields of an ERROR event. Views into the message.
+     */
+    struct ErrorData {
+        int code = 0;
+        std::string_view message;
+    };
 
-          return Result::Ok;
+    struct IpcMessage {
+        uint32_t op_code = 0;
+        std::string message;
+
+        /**
+         * @brief Indexes the top level of message, after which the accessors below are valid
+         * @return false if message is not a JSON object
+         */
+        bool Parse() {
+            cmd = evt = nonce = data = {};
+            index = nullptr;
+
+            JSON::JsonReader reader(message);
+            if (reader.Next().type != JSON::TokenType::BeginObject)
+                return false;
+
+            while (true) {
+                JSON::Token key = reader.Next();
+                if (key.type == JSON::TokenType::EndObject)
+                    return true;
+                if (key.type != JSON::TokenType::String)
+                    return false;
+
+                JSON::Token value = reader.Next();
+                std::string_view raw = reader.SkipValue(value);
+                if (raw.empty())
+                    return false;
+
+                std::string_view string = value.type == JSON::TokenType::String ? value.text : std::string_view();
+                if (key.text == "cmd") cmd = ToSpan(string);
+                else if (key.text == "evt") evt = ToSpan(string);
+                else if (key.text == "nonce") nonce = ToSpan(string);
+                else if (key.text == "data") data = ToSpan(raw);
+            }
         }
 
-        Result Close() override {
-          return Result::Ok;
+        std::string_view Cmd() const { return FromSpan(cmd); }
+        std::string_view Evt() const { return FromSpan(evt); }
+        /**
+         * @brief Empty for dispatch events, which carry no nonce
+         */
+        std::string_view Nonce() const { return FromSpan(nonce); }
+        /**
+         * @brief The raw JSON of the data member
+         */
+        std::string_view Data() const { return FromSpan(data); }
+
+        bool IsError() const {
+            return op_code == 2 || Evt() == "ERROR"; // 2 = close
         }
 
-        void CancelIo() override {
-          // not needed on unix
+        /**
+         * @brief The index over Data(). It is built on first use and shared by copies of this message.
+         */
+        const JSON::JsonIndex& DataIndex() const {
+            if (index == nullptr)
+                index = std::make_shared<const JSON::JsonIndex>(Data(), data.offset);
+            return *index;
         }
 
-        template<size_t N>
-        Result ReadBytes(std::array<std::byte, N>* buffer, bool peek = false) {
-          int bytes_available;
-          ioctl(socketfd, FIONREAD, &bytes_available);
+        /**
+         * @return The READY payload, or std::nullopt if this is not a READY dispatch
+         */
+        std::optional<ReadyData> Ready() const {
+            if (Evt() != "READY")
+                return std::nullopt;
 
-          if (bytes_available == 0) {
-            if (peek) return Result::ReadPipeNoData;
-            else return Result::ReadPipeFailed;
-          }
+            const auto& idx = DataIndex();
+            const auto text = [&](std::initializer_list<std::string_view> path) {
+                return idx.String(message, idx.Find(message, path));
+            };
 
-          return read(socketfd, buffer->data(), N) == N ? Result::Ok : Result::ReadPipeFailed;
+            ReadyData ready;
+            ready.version = idx.Number<int>(message, idx.Find(message, { "v" })).value_or(0);
+            ready.user.id = text({ "user", "id" });
+            ready.user.username = text({ "user", "username" });
+            ready.user.discriminator = text({ "user", "discriminator" });
+            ready.user.global_name = text({ "user", "global_name" });
+            ready.user.avatar = text({ "user", "avatar" });
+            ready.config.cdn_host = text({ "config", "cdn_host" });
+            ready.config.api_endpoint = text({ "config", "api_endpoint" });
+            ready.config.environment = text({ "config", "environment" });
+            return ready;
         }
 
-        Result Read(IpcMessage* msg, bool peek) override {
-          static std::regex nonce_re(R"(\"nonce\":\"([a-zA-Z0-9\-]+)\")");
+        /**
+         * @return The ERROR payload, or std::nullopt if this is not an ERROR event
+         */
+        std::optional<ErrorData> Error() const {
+            if (!IsError())
+                return std::nullopt;
+
+            const auto& idx = DataIndex();
+            ErrorData error;
+            error.code = idx.Number<int>(message, idx.Find(message, { "code" })).value_or(0);
+            error.message = idx.String(message, idx.Find(message, { "message" }));
+            return error;
+        }
+    private:
+        struct Span {
+            uint32_t offset = 0;
+            uint32_t length = 0;
+        };
 
-          std::array<std::byte, 4> op_code_bytes, msg_len_bytes;
+        Span ToSpan(std::string_view view) const {
+            if (view.empty()) return {};
+            return { static_cast<uint32_t>(view.data() - message.data()), static_cast<uint32_t>(view.size()) };
+        }
+
+        std::string_view FromSpan(Span span) const {
+            return std::string_view(message).substr(span.offset, span.length);
+        }
+
+        Span cmd;
+        Span evt;
+        Span nonce;
+        Span data;
+        mutable std::shared_ptr<const JSON::JsonIndex> index;
+    };
+
+    using ResultCallback = std::function<void(Result result, const IpcMessage& ipc_message)>;
+    using LogCallback = std::function<void(Result result, LogLevel level, std::string message, const IpcMessage* ipc_message)>;
+
+    /**
+     * @brief An outgoing message in wire format: op code and payload length followed by the JSON payload
+     */
+    struct IpcFrame {
+        static constexpr size_t header_size = 8;
+
+        std::string bytes;
+        uint64_t request_id = 0;
+
+        uint32_t OpCode() const {
+            uint32_t op_code;
+            std::memcpy(&op_code, bytes.data(), 4);
+            return op_code;
+        }
+
+        std::string_view Payload() const {
+            return std::string_view(bytes).substr(header_size);
+        }
+
+        IpcMessage ToMessage() const {
+            IpcMessage message;
+            message.op_code = OpCode();
+            message.message = Payload();
+            message.Parse();
+            return message;
+        }
+    };
+
+    /**
+     * @brief A JsonWriter which reserves the frame header in front of the payload, so the finished
+     * buffer can be sent as is
+     */
+    class IpcFrameWriter : public JSON::JsonWriter {
+    public:
+        explicit IpcFrameWriter(uint32_t op_code, size_t capacity = 0) : JsonWriter(IpcFrame::header_size + capacity) {
+            buffer.resize(IpcFrame::header_size);
+            std::memcpy(buffer.data(), &op_code, 4);
+        }
+
+        /**
+         * @brief Patches the payload length into the header and moves the frame out of the writer
+         */
+        std::string Finish() {
+            uint32_t length = static_cast<uint32_t>(buffer.size() - IpcFrame::header_size);
+            std::memcpy(buffer.data() + 4, &length, 4);
+            return Release();
+        }
+    };
+
+    /**
+     * @brief Byte ring buffer with a power of two capacity. Grows instead of overwriting
+     */
+    class RingBuffer {
+    public:
+        explicit RingBuffer(size_t capacity = 4096) : storage(std::bit_ceil(capacity)) {}
+
+        size_t Size() const { return tail - head; }
+
+        /**
+         * @brief The largest contiguous free region, to be filled and then committed
+         */
+        std::span<char> Writable() {
+            if (Size() == storage.size()) Grow(storage.size() * 2);
+
+            size_t begin = tail & (storage.size() - 1);
+            size_t end = std::min(storage.size(), begin + storage.size() - Size());
+            return std::span(storage.data() + begin, end - begin);
+        }
+
+        void Commit(size_t count) { tail += count; }
+
+        /**
+         * @brief Copies count bytes starting offset bytes after the read position, across the wrap if needed
+         */
+        void CopyOut(size_t offset, void* destination, size_t count) const {
+            size_t begin = (head + offset) & (storage.size() - 1);
+            size_t first = std::min(count, storage.size() - begin);
+            std::memcpy(destination, storage.data() + begin, first);
+            std::memcpy(static_cast<char*>(destination) + first, storage.data(), count - first);
+        }
+
+        void Consume(size_t count) {
+            head += count;
+
+            // Rewinding an empty buffer keeps the next read in one piece
+            if (head == tail) head = tail = 0;
+        }
+
+        void Reserve(size_t capacity) {
+            if (capacity > storage.size()) Grow(std::bit_ceil(capacity));
+        }
+
+        void Clear() { head = tail = 0; }
+    private:
+        void Grow(size_t capacity) {
+            std::vector<char> grown(capacity);
+            size_t size = Size();
+            CopyOut(0, grown.data(), size);
+            storage = std::move(grown);
+            head = 0;
+            tail = size;
+        }
+
+        std::vector<char> storage;
+        size_t head = 0;
+        size_t tail = 0;
+    };
+
+    /**
+     * @brief Splits a byte stream into frames. Bytes are read into the buffer in large chunks and every
+     * complete frame is taken out without touching the pipe again
+     */
+    class IpcFrameReader {
+    public:
+        static constexpr uint32_t max_payload_size = 16 * 1024 * 1024;
+
+        std::span<char> Writable() { return buffer.Writable(); }
+        void Commit(size_t count) { buffer.Commit(count); }
+        void Clear() { buffer.Clear(); }
+
+        /**
+         * @return ReadPipeNoData until a whole frame is buffered, ReadPipeFailed if the header is garbage
+         */
+        Result Next(IpcMessage* message) {
+            if (buffer.Size() < IpcFrame::header_size) return Result::ReadPipeNoData;
+
+            std::array<uint32_t, 2> header;
+            buffer.CopyOut(0, header.data(), IpcFrame::header_size);
+            auto [op_code, length] = header;
+            if (length > max_payload_size) return Result::ReadPipeFailed;
+
+            if (buffer.Size() < IpcFrame::header_size + length) {
+                // Make room for the rest of the frame up front so it arrives in as few reads as possible
+                buffer.Reserve(IpcFrame::header_size + length);
+                return Result::ReadPipeNoData;
+            }
+
+            message->op_code = op_code;
+            message->message.resize(length);
+            buffer.CopyOut(IpcFrame::header_size, message->message.data(), length);
+            buffer.Consume(IpcFrame::header_size + length);
+            message->Parse();
+
+            return Result::Ok;
+        }
+    private:
+        RingBuffer buffer;
+    };
+
+    class Pipe {
+    public:
+        virtual Result Open() = 0;
+        virtual Result Close() = 0;
+        virtual Result Read(IpcMessage* message, bool peek = false) = 0;
+        virtual void CancelIo() = 0;
+        /**
+         * @param frame A complete frame, header included
+         */
+        virtual Result Write(std::string_view frame) = 0;
+
+        /**
+         * @brief Writes as much of the frames as the pipe takes without blocking
+         * @param frames Complete frames, headers included
+         * @param offset Bytes of the first frame that were written by an earlier call
+         * @param written Receives the number of bytes written, 0 if the pipe is full
+         */
+        virtual Result WriteBatch(std::span<const std::string_view> frames, size_t offset, size_t* written) {
+            *written = 0;
+            for (auto frame : frames) {
+                std::string_view bytes = frame.substr(offset);
+                if (Result result = Write(bytes); result != Result::Ok) return result;
+                *written += bytes.size();
+                offset = 0;
+            }
+            return Result::Ok;
+        }
+
+        /**
+         * @brief Opens the pipe if needed, sends the handshake frame and waits for the first reply
+         * @return Result::HandshakeFailed if no reply arrives within the handshake timeout
+         */
+        virtual Result Handshake(std::string_view handshake, IpcMessage* reply) {
+            Result result;
+            if (result = Open(); result != Result::Ok) return result;
+            if (result = Write(handshake); result != Result::Ok) return result;
+
+            // Peeks rather than reads so a peer which never answers cannot block the caller
+            auto deadline = std::chrono::steady_clock::now() + handshake_timeout;
+            while ((result = Read(reply, true)) == Result::ReadPipeNoData) {
+                auto remaining = std::chrono::ceil<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now()).count();
+                if (remaining <= 0) return Result::HandshakeFailed;
+
+                #ifndef _WIN32
+                if (int fd = PollHandle(); fd >= 0) {
+                    pollfd poll_fd { .fd = fd, .events = POLLIN, .revents = 0 };
+                    if (poll(&poll_fd, 1, static_cast<int>(remaining)) < 0 && errno != EINTR) return Result::ReadPipeFailed;
+                    continue;
+                }
+                #endif
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+            return result;
+        }
+
+        virtual bool IsOpen() = 0;
+        /**
+         * @brief File descriptor that becomes readable when data arrives, or -1 if the pipe can only be polled
+         */
+        virtual int PollHandle() { return -1; }
+        /**
+         * @brief File descriptor that becomes readable once a full pipe takes data again, for pipes whose
+         * PollHandle cannot tell. -1 if PollHandle becomes writable instead
+         */
+        virtual int SpaceHandle() { return -1; }
+
+        /**
+         * @brief How long Handshake waits for the first reply
+         */
+        void SetHandshakeTimeout(std::chrono::milliseconds timeout) {
+            handshake_timeout = timeout;
+        }
+    protected:
+        std::chrono::milliseconds handshake_timeout { 5000 };
+    };
+
+    #ifdef _WIN32
+    class WindowsPipe final : public Pipe {
+    public:
+        /**
+         * @param instance The N in discord-ipc-N
+         */
+        explicit WindowsPipe(int instance = 0) : instance(instance) {}
+
+        ~WindowsPipe() {
+            Close();
+        }
+        
+        Result Open() override {
+            if (pipe_handle) return Result::Ok;
+
+            // Create pipe handle
+            std::string path = std::format("\\\\.\\pipe\\discord-ipc-{}", instance);
+            HANDLE pipe = CreateFileA(
+                path.c_str(),
+                GENERIC_READ | GENERIC_WRITE,
+                NULL,
+                NULL,
+                OPEN_EXISTING,
+                NULL,
+                NULL
+            );
+
+            if (pipe != INVALID_HANDLE_VALUE) {
+                pipe_handle = pipe;
+
+                DWORD mode = PIPE_READMODE_BYTE;
+                if (!SetNamedPipeHandleState(pipe, &mode, NULL, NULL)) {
+                    Close();
+                    return Result::OpenPipeFailed;
+                }
+            } else {
+                return Result::OpenPipeFailed;
+            }
+
+            return Result::Ok;
+        }
+
+        Result Close() override {
+            CloseHandle(pipe_handle);
+            pipe_handle = NULL;
+            return Result::Ok;
+        }
+
+        template<size_t N>
+        Result ReadBytes(std::array<std::byte, N>* buffer, bool peek = false) {
+            DWORD bytes_read;
+            if (peek) {
+                DWORD bytes_available;
+                if (PeekNamedPipe(pipe_handle, NULL, NULL, NULL, &bytes_available, NULL)) {
+                    if (bytes_available > 0)
+                        goto read;
+                    else
+                        return Result::ReadPipeNoData;
+                }
+                return Result::ReadPipeFailed;
+            } else {
+                read:
+                if (!ReadFile(pipe_handle, buffer->data(), buffer->size(), &bytes_read, 0)
+                    || bytes_read != buffer->size()) {
+                    return Result::ReadPipeFailed;
+                }
+            }
+            return Result::Ok;
+        }
+
+        Result Read(IpcMessage* message, bool peek = false) override {
+            std::array<std::byte, 4> op_code_bytes, msg_len_bytes;
+
+            Result result;
+            if (result = ReadBytes(&op_code_bytes, peek); result != Result::Ok) return result;
+            if (result = ReadBytes(&msg_len_bytes, peek); result != Result::Ok) return result;
+
+            message->op_code = std::bit_cast<uint32_t>(op_code_bytes);
+            uint32_t msg_len = std::bit_cast<uint32_t>(msg_len_bytes);
+            
+            std::vector<char> buffer(msg_len);
+            DWORD bytes_read;
+
+            if (peek) {
+                DWORD bytes_available;
+                if (PeekNamedPipe(pipe_handle, NULL, NULL, NULL, &bytes_available, NULL)) {
+                    if (bytes_available > 0)
+                        goto read;
+                    else
+                        return Result::ReadPipeNoData;
+                } else {
+                    return Result::ReadPipeFailed;
+                }
+            } else {
+                read:
+                if (!ReadFile(pipe_handle, buffer.data(), msg_len, &bytes_read, 0) || bytes_read != msg_len) {
+                    return Result::ReadPipeFailed;
+                }
+            }
+            message->message = std::string(buffer.begin(), buffer.end());
+            message->Parse();
+
+            return Result::Ok;
+        }
+
+        void CancelIo() override {
+            ::CancelIo(pipe_handle);
+        }
+
+        Result Write(std::string_view frame) override {
+            DWORD bytes_written;
+            return WriteFile(
+                pipe_handle,
+                frame.data(),
+                static_cast<DWORD>(frame.size()),
+                &bytes_written, 0
+            ) && bytes_written == frame.size() ? Result::Ok : Result::WritePipeFailed;
+        }
+
+        bool IsOpen() override {
+            return pipe_handle && GetNamedPipeHandleState(pipe_handle, NULL, NULL, NULL, NULL, NULL, 0);
+        }
+    private:
+        HANDLE pipe_handle = NULL;
+        int instance;
+    };
+
+    #else
+
+    class UnixPipe : public Pipe {
+      public:
+        /**
+         * @param instance The N in discord-ipc-N, or -1 to take whichever instance is found first
+         */
+        explicit UnixPipe(int instance = -1) : instance(instance) {}
+
+        ~UnixPipe() {
+          Close();
+        }
+
+        Result Open() override {
+          if (socketfd >= 0) return Result::Ok;
+
+          // The path that worked last time is almost always the one Discord is still on
+          if (!cached_path.empty() && (socketfd = ConnectTo(cached_path)) >= 0)
+            return Result::Ok;
+
+          for (const auto& path : CandidatePaths(instance)) {
+            if (path == cached_path) continue;
+
+            if ((socketfd = ConnectTo(path)) >= 0) {
+              cached_path = path;
+              return Result::Ok;
+            }
+          }
+
+          return Result::OpenPipeFailed;
+        }
+
+        /**
+         * @brief Socket paths Discord may listen on. Every directory is tried for discord-ipc-0 before
+         * moving on to the next instance number
+         * @param instance Only list discord-ipc-N for this N, or every instance if negative
+         */
+        static std::vector<std::string> CandidatePaths(int instance = -1) {
+          std::vector<std::string> directories;
+          auto add_directory = [&](std::string directory) {
+            while (directory.size() > 1 && directory.back() == '/') directory.pop_back();
+            if (!directory.empty() && std::ranges::find(directories, directory) == directories.end())
+              directories.push_back(std::move(directory));
+          };
+
+          for (const char* variable : { "XDG_RUNTIME_DIR", "TMPDIR", "TMP", "TEMP" }) {
+            if (const char* value = getenv(variable)) add_directory(value);
+          }
+          add_directory("/run/user/" + std::to_string(getuid()));
+          add_directory("/tmp");
+
+          // Plain install, Flatpak and Snap
+          constexpr std::array<std::string_view, 3> subdirectories { "", "/app/com.discordapp.Discord", "/snap.discord" };
+
+          int first = instance < 0 ? 0 : instance;
+          int last = instance < 0 ? 9 : instance;
+
+          std::vector<std::string> paths;
+          paths.reserve((last - first + 1) * directories.size() * subdirectories.size());
+          for (int number = first; number <= last; number++) {
+            for (const auto& directory : directories) {
+              for (auto subdirectory : subdirectories) {
+                paths.push_back(std::format("{}{}/discord-ipc-{}", directory, subdirectory, number));
+              }
+            }
+          }
+
+          return paths;
+        }
+
+        /**
+         * @brief Connects to every candidate at once and sends each the handshake. The first socket
+         * to answer with READY is kept and the others are closed
+         */
+        Result Handshake(std::string_view handshake, IpcMessage* reply) override {
+          if (socketfd >= 0) return Pipe::Handshake(handshake, reply);
+
+          struct Contestant {
+            int fd;
+            std::string path;
+            size_t sent = 0;
+            IpcFrameReader reader;
+          };
+
+          std::vector<Contestant> contestants;
+          auto paths = CandidatePaths(instance);
+          if (auto cached = std::ranges::find(paths, cached_path); cached != paths.end())
+            std::rotate(paths.begin(), cached, cached + 1); // Wins ties
+
+          for (auto& path : paths) {
+            if (int fd = StartConnect(path); fd >= 0)
+              contestants.push_back(Contestant { .fd = fd, .path = std::move(path), .sent = 0, .reader = {} });
+          }
+
+          if (contestants.empty()) return Result::OpenPipeFailed;
+
+          Result result = Result::OpenPipeFailed;
+          auto deadline = std::chrono::steady_clock::now() + handshake_timeout;
+          std::vector<pollfd> poll_fds;
+          Contestant* winner = nullptr;
+
+          while (!contestants.empty() && winner == nullptr) {
+            auto remaining = std::chrono::ceil<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now()).count();
+            if (remaining <= 0) {
+              result = Result::HandshakeFailed;
+              break;
+            }
+
+            // Writable first while the handshake is going out, readable after
+            poll_fds.clear();
+            for (const auto& contestant : contestants) {
+              short events = contestant.sent < handshake.size() ? POLLOUT : POLLIN;
+              poll_fds.push_back(pollfd { .fd = contestant.fd, .events = events, .revents = 0 });
+            }
+
+            if (poll(poll_fds.data(), poll_fds.size(), static_cast<int>(remaining)) < 0) {
+              if (errno == EINTR) continue;
+              break;
+            }
+
+            for (size_t i = 0; i < contestants.size() && winner == nullptr; i++) {
+              auto& contestant = contestants[i];
+              short revents = poll_fds[i].revents;
+              bool dropped = (revents & (POLLERR | POLLNVAL)) != 0;
+
+              if (!dropped && (revents & POLLOUT)) {
+                ssize_t sent = send(contestant.fd, handshake.data() + contestant.sent, handshake.size() - contestant.sent, no_signal | MSG_DONTWAIT);
+                if (sent >= 0) contestant.sent += sent;
+                else dropped = errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR;
+              } else if (!dropped && (revents & (POLLIN | POLLHUP))) {
+                auto space = contestant.reader.Writable();
+                ssize_t received = recv(contestant.fd, space.data(), space.size(), MSG_DONTWAIT);
+                if (received > 0) contestant.reader.Commit(received);
+                else dropped = received == 0 || (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR);
+
+                IpcMessage message;
+                if (Result next = contestant.reader.Next(&message); next == Result::Ok) {
+                  if (message.op_code == 1 && message.Ready()) {
+                    *reply = std::move(message);
+                    winner = &contestant;
+                    break;
+                  }
+
+                  // Answered, but not with READY
+                  *reply = std::move(message);
+                  result = Result::HandshakeFailed;
+                  dropped = true;
+                } else if (next != Result::ReadPipeNoData) {
+                  dropped = true;
+                }
+              }
+
+              if (dropped) {
+                close(contestant.fd);
+                contestant.fd = -1;
+              }
+            }
+
+            if (winner == nullptr)
+              std::erase_if(contestants, [](const Contestant& contestant) { return contestant.fd < 0; });
+          }
+
+          for (auto& contestant : contestants) {
+            if (&contestant != winner && contestant.fd >= 0) close(contestant.fd);
+          }
+
+          if (winner == nullptr) return result;
+
+          fcntl(winner->fd, F_SETFL, fcntl(winner->fd, F_GETFL) & ~O_NONBLOCK);
+          socketfd = winner->fd;
+          cached_path = std::move(winner->path);
+
+          // Anything sent right after READY is already buffered
+          reader = std::move(winner->reader);
+          return Result::Ok;
+        }
+
+        Result Close() override {
+          if (socketfd >= 0) {
+            close(socketfd);
+            socketfd = -1;
+          }
+
+          // Whatever is left belongs to the old connection
+          reader.Clear();
+          return Result::Ok;
+        }
+
+        void CancelIo() override {
+          // not needed on unix
+        }
+
+        Result Read(IpcMessage* msg, bool peek = false) override {
+          while (true) {
+            if (Result result = reader.Next(msg); result != Result::ReadPipeNoData) return result;
+
+            auto space = reader.Writable();
+            ssize_t received = recv(socketfd, space.data(), space.size(), MSG_DONTWAIT);
+            if (received > 0) {
+              reader.Commit(received);
+              continue;
+            }
+
+            // The other end closed the socket
+            if (received == 0) return Result::ReadPipeFailed;
+
+            if (errno == EINTR) continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK) return Result::ReadPipeFailed;
+            if (peek) return Result::ReadPipeNoData;
+
+            pollfd poll_fd { .fd = socketfd, .events = POLLIN, .revents = 0 };
+            if (poll(&poll_fd, 1, -1) < 0 && errno != EINTR) return Result::ReadPipeFailed;
+          }
+        }
+
+        Result Write(std::string_view frame) override {
+          while (!frame.empty()) {
+            ssize_t sent = send(socketfd, frame.data(), frame.size(), no_signal);
+            if (sent < 0 && errno == EINTR) continue;
+            if (sent < 0) return Result::WritePipeFailed;
+            frame.remove_prefix(sent);
+          }
+          return Result::Ok;
+        }
+
+        Result WriteBatch(std::span<const std::string_view> frames, size_t offset, size_t* written) override {
+          // Frames carry their header in front of the payload, so one iovec covers each
+          std::array<iovec, 64> buffers;
+          size_t count = std::min(frames.size(), buffers.size());
+          for (size_t i = 0; i < count; i++) {
+            std::string_view bytes = frames[i].substr(i == 0 ? offset : 0);
+            buffers[i] = iovec { .iov_base = const_cast<char*>(bytes.data()), .iov_len = bytes.size() };
+          }
+
+          msghdr header {};
+          header.msg_iov = buffers.data();
+          header.msg_iovlen = count;
+
+          while (true) {
+            ssize_t sent = sendmsg(socketfd, &header, no_signal | MSG_DONTWAIT);
+            if (sent >= 0) {
+              *written = static_cast<size_t>(sent);
+              return Result::Ok;
+            }
+
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+              *written = 0;
+              return Result::Ok;
+            }
+            return Result::WritePipeFailed;
+          }
+        }
+
+        bool IsOpen() override {
+          return socketfd >= 0;
+        }
+
+        int PollHandle() override {
+          return socketfd;
+        }
+      protected:
+        /**
+         * @brief Takes over a socket that is already connected
+         */
+        void Adopt(int fd) {
+          Close();
+          fcntl(fd, F_SETFD, FD_CLOEXEC);
+
+          #ifdef SO_NOSIGPIPE
+          int enable = 1;
+          setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &enable, sizeof(enable));
+          #endif
+
+          socketfd = fd;
+        }
+      private:
+        static constexpr int connect_timeout_ms = 200;
+
+        /**
+         * @return A non-blocking socket that is connected or still connecting, or -1
+         */
+        static int StartConnect(const std::string& path) {
+          sockaddr_un addr {};
+          if (path.size() >= sizeof(addr.sun_path)) return -1;
+          addr.sun_family = AF_UNIX;
+          std::memcpy(addr.sun_path, path.data(), path.size());
+
+          int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+          if (fd < 0) return -1;
+          fcntl(fd, F_SETFD, FD_CLOEXEC);
+
+          // Connect without blocking so a socket nobody accepts on cannot stall the search
+          fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+
+          if (connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 && errno != EINPROGRESS) {
+            close(fd);
+            return -1;
+          }
+
+          #ifdef SO_NOSIGPIPE
+          int enable = 1;
+          setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &enable, sizeof(enable));
+          #endif
+
+          return fd;
+        }
+
+        /**
+         * @return A connected blocking socket, or -1
+         */
+        static int ConnectTo(const std::string& path) {
+          int fd = StartConnect(path);
+          if (fd < 0) return -1;
+
+          pollfd poll_fd { .fd = fd, .events = POLLOUT, .revents = 0 };
+          int error = 0;
+          socklen_t length = sizeof(error);
+          bool connected = poll(&poll_fd, 1, connect_timeout_ms) == 1
+            && getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &length) == 0
+            && error == 0;
+
+          if (!connected) {
+            close(fd);
+            return -1;
+          }
+
+          fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_NONBLOCK);
+          return fd;
+        }
+
+        // A dead peer must fail the write instead of raising SIGPIPE
+        #ifdef MSG_NOSIGNAL
+        static constexpr int no_signal = MSG_NOSIGNAL;
+        #else
+        static constexpr int no_signal = 0; // SO_NOSIGPIPE is set on the socket instead
+        #endif
+
+        int socketfd = -1;
+        int instance;
+        std::string cached_path;
+        IpcFrameReader reader;
+    };
+
+    /**
+     * @brief One end of a socketpair, for tests and benchmarks which run both sides in one process
+     */
+    class SocketPairPipe final : public UnixPipe {
+      public:
+        /**
+         * @return Two pipes connected to each other, or two null pointers
+         */
+        static std::pair<std::shared_ptr<SocketPairPipe>, std::shared_ptr<SocketPairPipe>> CreatePair() {
+          int fds[2];
+          if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0) return {};
+          return { std::make_shared<SocketPairPipe>(fds[0]), std::make_shared<SocketPairPipe>(fds[1]) };
+        }
+
+        explicit SocketPairPipe(int fd) {
+          Adopt(fd);
+        }
+
+        // A closed end stays closed, there is nothing to discover
+        Result Open() override {
+          return IsOpen() ? Result::Ok : Result::OpenPipeFailed;
+        }
+
+        Result Handshake(std::string_view handshake, IpcMessage* reply) override {
+          return Pipe::Handshake(handshake, reply);
+        }
+    };
+
+    #endif
+
+    /**
+     * @brief In-process pipe made of two lock-free single producer, single consumer byte rings. Each end
+     * may be read by one thread and written by one thread. On Linux each direction has an eventfd for
+     * new data and one for freed space, so the client loop and blocking calls wait on them like on a socket
+     */
+    class LoopbackPipe final : public Pipe {
+        struct Channel;
+    public:
+        /**
+         * @param capacity Bytes each direction can hold. A frame has to fit in one go
+         */
+        static std::pair<std::shared_ptr<LoopbackPipe>, std::shared_ptr<LoopbackPipe>> CreatePair(size_t capacity = 1 << 20) {
+            auto forward = std::make_shared<Channel>(capacity);
+            auto backward = std::make_shared<Channel>(capacity);
+            return { std::make_shared<LoopbackPipe>(backward, forward), std::make_shared<LoopbackPipe>(forward, backward) };
+        }
+
+        LoopbackPipe(std::shared_ptr<Channel> incoming, std::shared_ptr<Channel> outgoing)
+            : incoming(std::move(incoming)), outgoing(std::move(outgoing)) {}
+
+        ~LoopbackPipe() {
+            Close();
+        }
+
+        Result Open() override {
+            return IsOpen() ? Result::Ok : Result::OpenPipeFailed;
+        }
+
+        Result Close() override {
+            if (!open) return Result::Ok;
+            open = false;
+
+            // Both directions die with either end, and whoever waits on them wakes up
+            incoming->Shut();
+            outgoing->Shut();
+            return Result::Ok;
+        }
+
+        Result Read(IpcMessage* message, bool peek = false) override {
+            while (true) {
+                if (incoming->Pop(message)) return Result::Ok;
+                if (!open || incoming->closed.load(std::memory_order_acquire)) {
+                    // Frames written before the close are still delivered
+                    if (incoming->Pop(message)) return Result::Ok;
+                    return Result::ReadPipeFailed;
+                }
+
+                if (peek) {
+                    // Cleared before the last look so a frame pushed in between signals again
+                    Channel::Clear(incoming->signal);
+                    return incoming->Pop(message) ? Result::Ok : Result::ReadPipeNoData;
+                }
+
+                Channel::Wait(incoming->signal);
+            }
+        }
+
+        void CancelIo() override {}
+
+        Result Write(std::string_view frame) override {
+            if (!open || outgoing->closed.load(std::memory_order_acquire)) return Result::WritePipeFailed;
+            if (frame.size() > outgoing->bytes.size()) return Result::WritePipeFailed;
+
+            while (!outgoing->PushOrRequestSpace(frame)) {
+                if (outgoing->closed.load(std::memory_order_acquire)) return Result::WritePipeFailed;
+                Channel::Wait(outgoing->space);
+            }
+
+            Channel::Notify(outgoing->signal);
+            return Result::Ok;
+        }
+
+        /**
+         * @brief Pushes whole frames until the channel is full. Unlike Write it never waits, so two ends
+         * flooding each other cannot deadlock. Once full, SpaceHandle signals when the reader made room
+         */
+        Result WriteBatch(std::span<const std::string_view> frames, size_t offset, size_t* written) override {
+            *written = 0;
+            if (!open || outgoing->closed.load(std::memory_order_acquire)) return Result::WritePipeFailed;
+
+            for (auto frame : frames) {
+                // Frames are only ever pushed whole, so offset is 0 or a full frame
+                std::string_view bytes = frame.substr(std::min(offset, frame.size()));
+                offset = 0;
+                if (bytes.size() > outgoing->bytes.size()) return Result::WritePipeFailed;
+                if (!bytes.empty() && !outgoing->PushOrRequestSpace(bytes)) break;
+                *written += bytes.size();
+            }
+
+            if (*written > 0) Channel::Notify(outgoing->signal);
+            return Result::Ok;
+        }
+
+        bool IsOpen() override {
+            return open;
+        }
+
+        int PollHandle() override {
+            return open ? incoming->signal : -1;
+        }
+
+        int SpaceHandle() override {
+            return open ? outgoing->space : -1;
+        }
+
+    private:
+        struct Channel {
+            explicit Channel(size_t capacity) : bytes(std::bit_ceil(capacity)) {
+                #ifdef __linux__
+                signal = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+                space = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+                #endif
+            }
+
+            ~Channel() {
+                #ifdef __linux__
+                if (signal >= 0) close(signal);
+                if (space >= 0) close(space);
+                #endif
+            }
+
+            /**
+             * @brief Appends a whole frame, or nothing if it does not fit yet
+             */
+            bool Push(std::string_view frame) {
+                size_t write = tail.load(std::memory_order_relaxed);
+                size_t read = head.load(std::memory_order_acquire);
+                if (bytes.size() - (write - read) < frame.size()) return false;
+
+                size_t begin = write & (bytes.size() - 1);
+                size_t first = std::min(frame.size(), bytes.size() - begin);
+                std::memcpy(bytes.data() + begin, frame.data(), first);
+                std::memcpy(bytes.data(), frame.data() + first, frame.size() - first);
+                tail.store(write + frame.size(), std::memory_order_release);
+                return true;
+            }
+
+            /**
+             * @brief Like Push, but if the frame does not fit yet the reader signals space once it took a frame
+             */
+            bool PushOrRequestSpace(std::string_view frame) {
+                if (Push(frame)) return true;
+
+                // Cleared before asking so the reader's answer is not lost, and the fence pairs with the
+                // one in Pop: either the reader sees the request or the last look sees the freed space
+                Clear(space);
+                space_requested.store(true, std::memory_order_relaxed);
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+                return Push(frame);
+            }
+
+            /**
+             * @brief Takes the next frame if it is complete
+             */
+            bool Pop(IpcMessage* message) {
+                size_t read = head.load(std::memory_order_relaxed);
+                size_t available = tail.load(std::memory_order_acquire) - read;
+                if (available < IpcFrame::header_size) return false;
+
+                std::array<uint32_t, 2> header;
+                CopyOut(read, header.data(), IpcFrame::header_size);
+                auto [op_code, length] = header;
+                if (available < IpcFrame::header_size + length) return false;
+
+                message->op_code = op_code;
+                message->message.resize(length);
+                CopyOut(read + IpcFrame::header_size, message->message.data(), length);
+                head.store(read + IpcFrame::header_size + length, std::memory_order_release);
+
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+                if (space_requested.load(std::memory_order_relaxed) && space_requested.exchange(false, std::memory_order_relaxed))
+                    Notify(space);
+
+                message->Parse();
+                return true;
+            }
+
+            void CopyOut(size_t position, void* destination, size_t count) const {
+                size_t begin = position & (bytes.size() - 1);
+                size_t first = std::min(count, bytes.size() - begin);
+                std::memcpy(destination, bytes.data() + begin, first);
+                std::memcpy(static_cast<char*>(destination) + first, bytes.data(), count - first);
+            }
+
+            /**
+             * @brief Marks the channel closed and wakes both sides
+             */
+            void Shut() {
+                closed.store(true, std::memory_order_release);
+                Notify(signal);
+                Notify(space);
+            }
+
+            static void Notify(int fd) {
+                #ifdef __linux__
+                uint64_t one = 1;
+                [[maybe_unused]] auto written = write(fd, &one, sizeof(one));
+                #endif
+            }
+
+            static void Clear(int fd) {
+                #ifdef __linux__
+                uint64_t count;
+                [[maybe_unused]] auto read_bytes = read(fd, &count, sizeof(count));
+                #endif
+            }
+
+            /**
+             * @brief Blocks until fd was notified, then clears it. Callers look at the ring again afterwards
+             */
+            static void Wait(int fd) {
+                #ifdef __linux__
+                pollfd poll_fd { .fd = fd, .events = POLLIN, .revents = 0 };
+                while (poll(&poll_fd, 1, -1) < 0 && errno == EINTR) {}
+                Clear(fd);
+                #else
+                std::this_thread::yield();
+                #endif
+            }
+
+            std::vector<char> bytes;
+            alignas(64) std::atomic<size_t> head = 0; // advanced by the reader
+            alignas(64) std::atomic<size_t> tail = 0; // advanced by the writer
+            std::atomic<bool> closed = false;
+            std::atomic<bool> space_requested = false; // the writer waits for the reader to take a frame
+            int signal = -1; // readable once the writer pushed a frame
+            int space = -1; // readable once the reader took a frame the writer was waiting for
+        };
+
+        std::shared_ptr<Channel> incoming;
+        std::shared_ptr<Channel> outgoing;
+        bool open = true;
+    };
+
+
+    /**
+     * @brief Blocks the client loop until a pipe has data or another thread calls Wake.
+     * On Linux this is an epoll set holding the pipes and an eventfd; elsewhere it falls back
+     * to a condition variable and the loop keeps polling the pipes
+     */
+    class Reactor {
+    public:
+        /**
+         * @brief Bit N is set for the handle watched under token N
+         */
+        struct Readiness {
+            uint64_t readable = 0;
+            uint64_t hangup = 0;
+        };
+
+        #ifdef __linux__
+        Reactor() {
+            epollfd = epoll_create1(EPOLL_CLOEXEC);
+            wakefd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+            epoll_event event {};
+            event.events = EPOLLIN;
+            event.data.u64 = wake_token;
+            epoll_ctl(epollfd, EPOLL_CTL_ADD, wakefd, &event);
+        }
+
+        ~Reactor() {
+            if (wakefd >= 0) close(wakefd);
+            if (epollfd >= 0) close(epollfd);
+        }
+
+        Reactor(const Reactor&) = delete;
+        Reactor& operator=(const Reactor&) = delete;
+
+        /**
+         * @brief Adds a pipe handle to the set or updates it. Closing the handle removes it again
+         * @param token Bit of Readiness the handle reports on, below 64
+         * @param writable Also wake up once the pipe can take more data
+         * @return false if the handle cannot be waited on and has to be polled
+         */
+        bool Watch(int fd, uint32_t token, bool writable = false) {
+            if (fd < 0 || epollfd < 0 || token >= 64) return false;
+
+            epoll_event event {};
+            event.events = EPOLLIN | EPOLLRDHUP;
+            if (writable) event.events |= EPOLLOUT;
+            event.data.u64 = token;
+            if (epoll_ctl(epollfd, EPOLL_CTL_ADD, fd, &event) == 0) return true;
+            return errno == EEXIST && epoll_ctl(epollfd, EPOLL_CTL_MOD, fd, &event) == 0;
+        }
+
+        /**
+         * @brief Removes a handle that stays open from the set
+         */
+        void Unwatch(int fd) {
+            if (fd >= 0 && epollfd >= 0) epoll_ctl(epollfd, EPOLL_CTL_DEL, fd, nullptr);
+        }
+
+        void Wake() {
+            uint64_t one = 1;
+            [[maybe_unused]] auto written = write(wakefd, &one, sizeof(one));
+        }
+
+        /**
+         * @param timeout_ms -1 blocks until something happens
+         */
+        Readiness Wait(int timeout_ms) {
+            Readiness readiness;
+            std::array<epoll_event, 16> events;
+
+            int count = epoll_wait(epollfd, events.data(), events.size(), timeout_ms);
+            for (int i = 0; i < count; i++) {
+                uint64_t token = events[i].data.u64;
+                if (token == wake_token) {
+                    uint64_t wakes;
+                    [[maybe_unused]] auto read_bytes = read(wakefd, &wakes, sizeof(wakes));
+                    continue;
+                }
+
+                if (events[i].events & EPOLLIN)
+                    readiness.readable |= uint64_t(1) << token;
+                if (events[i].events & (EPOLLHUP | EPOLLRDHUP | EPOLLERR))
+                    readiness.hangup |= uint64_t(1) << token;
+            }
+
+            return readiness;
+        }
+    private:
+        static constexpr uint64_t wake_token = UINT64_MAX;
+
+        int epollfd = -1;
+        int wakefd = -1;
+        #else
+        bool Watch(int, uint32_t, bool = false) {
+            return false;
+        }
+
+        void Unwatch(int) {}
+
+        void Wake() {
+            std::lock_guard lock(mutex);
+            woken = true;
+            condition.notify_one();
+        }
+
+        Readiness Wait(int timeout_ms) {
+            std::unique_lock lock(mutex);
+            auto is_woken = [this] { return woken; };
+            if (timeout_ms < 0) condition.wait(lock, is_woken);
+            else condition.wait_for(lock, std::chrono::milliseconds(timeout_ms), is_woken);
+            woken = false;
+
+            // Without handles to wait on every pipe has to be checked every time
+            return Readiness { .readable = UINT64_MAX };
+        }
+    private:
+        std::mutex mutex;
+        std::condition_variable condition;
+        bool woken = false;
+        #endif
+    };
+
+    #pragma region Activity Types
+
+    /**
+     * @brief Order sensitive 64-bit hash of a sequence of values, used to tell whether an activity changed.
+     * Not stable across builds or platforms
+     */
+    class StructuralHash {
+    public:
+        StructuralHash& Add(std::string_view text) {
+            Mix(std::hash<std::string_view>()(text));
+            return *this;
+        }
+
+        template<typename T> requires std::is_integral_v<T> || std::is_enum_v<T>
+        StructuralHash& Add(T value) {
+            Mix(static_cast<uint64_t>(value));
+            return *this;
+        }
+
+        uint64_t Value() const {
+            return state;
+        }
+    private:
+        void Mix(uint64_t value) {
+            state = (state ^ value) * 0x9E3779B97F4A7C15;
+            state ^= state >> 29;
+        }
+
+        uint64_t state = 0xCBF29CE484222325;
+    };
+
+    /**
+     * @brief Process-wide counter for the revisions of activity parts. A revision names one state of
+     * one object, and copying an object copies it along with that state
+     */
+    inline uint64_t NextRevision() {
+        static std::atomic<uint64_t> counter = 0;
+        return counter.fetch_add(1, std::memory_order_relaxed) + 1;
+    }
+
+    class Timestamps {
+    public:
+        void SetStart(int64_t seconds) { start = seconds; revision = NextRevision(); }
+        void SetEnd(int64_t seconds) { end = seconds; revision = NextRevision(); }
+        int64_t GetStart() const { return start; }
+        int64_t GetEnd() const { return end; }
+
+        static constexpr auto JsonFields() {
+            constexpr auto unset = [](const int64_t& seconds) { return seconds <= 0; };
+            return std::make_tuple(
+                JSON::Field { "\"start\":", &Timestamps::start, unset },
+                JSON::Field { "\"end\":", &Timestamps::end, unset }
+            );
+        }
+
+        void ToJson(JSON::JsonWriter* writer) const {
+            JSON::Serialize(writer, *this);
+        }
+
+        uint64_t Hash() const {
+            return StructuralHash().Add(start).Add(end).Value();
+        }
+
+        /**
+         * @brief Changes with every setter call
+         */
+        uint64_t GetRevision() const {
+            return revision;
+        }
+    private:
+        int64_t start = 0;
+        int64_t end = 0;
+        uint64_t revision = 0;
+    };
+
+    class Party {
+    public:
+        void SetId(std::string id) {
+            this->id = id;
+            revision = NextRevision();
+        }
+        std::string GetId() {
+            return id;
+        }
+
+        /**
+         * @param size Must be greater equals 0
+         */
+        void SetCurrentSize(int size) {
+            assert(size >= 0);
+            this->size[0] = size;
+            revision = NextRevision();
+        }
+        int GetCurrentSize() const {
+            return size[0];
+        }
+
+        /**
+         * @param size Must be greater equals 0 and the current size
+         */
+        void SetMaxSize(int size) {
+            assert(size >= 0 && size >= this->size[0]);
+            this->size[1] = size;
+            revision = NextRevision();
+        }
+        int GetMaxSize() const {
+            return size[1];
+        }
+
+        static constexpr auto JsonFields() {
+            return std::make_tuple(
+                JSON::Field { "\"id\":", &Party::id, [](const std::string& id) { return id.empty(); } },
+                JSON::Field { "\"size\":", &Party::size, [](const std::array<int, 2>& size) { return size[0] == 0 && size[1] == 0; } }
+            );
+        }
+
+        void ToJson(JSON::JsonWriter* writer) const {
+            JSON::Serialize(writer, *this);
+        }
+
+        uint64_t Hash() const {
+            return StructuralHash().Add(id).Add(size[0]).Add(size[1]).Value();
+        }
+
+        uint64_t GetRevision() const {
+            return revision;
+        }
+    private:
+        std::string id;
+        std::array<int, 2> size {}; // current, max
+        uint64_t revision = 0;
+    };
+
+    class Assets {
+    public:
+        void SetLargeImage(std::string image) {
+            large_image = image;
+            revision = NextRevision();
+        }
+        std::string GetLargeImage() const {
+            return large_image;
+        }
+
+        void SetLargeImageText(std::string text) {
+            large_text = text;
+            revision = NextRevision();
+        }
+        std::string GetLargeImageText() const {
+            return large_text;
+        }
+
+        void SetSmallImage(std::string image) {
+            small_image = image;
+            revision = NextRevision();
+        }
+        std::string GetSmallImage() const {
+            return small_image;
+        }
+
+        void SetSmallImageText(std::string text) {
+            small_text = text;
+            revision = NextRevision();
+        }
+        std::string GetSmallImageText() const {
+            return small_text;
+        }
+
+        static constexpr auto JsonFields() {
+            constexpr auto empty = [](const std::string& value) { return value.empty(); };
+            return std::make_tuple(
+                JSON::Field { "\"large_image\":", &Assets::large_image, empty },
+                JSON::Field { "\"large_text\":", &Assets::large_text, empty },
+                JSON::Field { "\"small_image\":", &Assets::small_image, empty },
+                JSON::Field { "\"small_text\":", &Assets::small_text, empty }
+            );
+        }
+
+        void ToJson(JSON::JsonWriter* writer) const {
+            JSON::Serialize(writer, *this);
+        }
+
+        bool IsEmpty() const {
+            return large_image.empty() && large_text.empty() && small_image.empty() && small_text.empty();
+        }
+
+        uint64_t Hash() const {
+            return StructuralHash().Add(large_image).Add(large_text).Add(small_image).Add(small_text).Value();
+        }
+
+        uint64_t GetRevision() const {
+            return revision;
+        }
+    private:
+        std::string large_image;
+        std::string large_text;
+        std::string small_image;
+        std::string small_text;
+        uint64_t revision = 0;
+    };
+
+    class Button {
+    public:
+        Button(std::string label, std::string url) {
+            SetLabel(label);
+            SetUrl(url);
+        }
+
+        void SetLabel(std::string label) {
+            assert(label.length() < 32);
+            this->label = label;
+            revision = NextRevision();
+        }
+        std::string GetLabel() const {
+            return label;
+        }
+
+        void SetUrl(std::string url) {
+            assert(url.length() < 512);
+            this->url = url;
+            revision = NextRevision();
+        }
+        std::string GetUrl() const {
+            return url;
+        }
+
+        static constexpr auto JsonFields() {
+            return std::make_tuple(
+                JSON::Field { "\"label\":", &Button::label },
+                JSON::Field { "\"url\":", &Button::url }
+            );
+        }
+
+        void ToJson(JSON::JsonWriter* writer) const {
+            JSON::Serialize(writer, *this);
+        }
+
+        uint64_t Hash() const {
+            return StructuralHash().Add(label).Add(url).Value();
+        }
+
+        uint64_t GetRevision() const {
+            return revision;
+        }
+    private:
+        std::string label;
+        std::string url;
+        uint64_t revision = 0;
+    };
+
+    enum class ActivityType {
+        Playing = 0,
+        Listening = 2,
+        Watching = 3,
+        Competing = 5
+    };
+
+    class Activity {
+    public:
+        /**
+         * @brief Set the client/application id
+         * @param client_id 0 = use id from client
+         */
+        void SetClientId(uint64_t client_id) {
+            this->client_id = client_id;
+            MarkDirty(Field::ClientId);
+        }
+        uint64_t GetClientId() const {
+            return this->client_id;
+        }
+
+        /**
+         * @brief Sets the name of the activity
+         * @param name Length must be greater than 0
+         */
+        void SetName(std::string name) {
+            assert(name.length() > 0);
+            this->name = name;
+            MarkDirty(Field::Name);
+        }
+        std::string GetName() const {
+            return name;
+        }
+
+        void SetType(ActivityType type) {
+            this->type = type;
+            MarkDirty(Field::Type);
+        }
+        ActivityType GetType() const {
+            return type;
+        }
+
+        void SetDetails(std::string details) {
+            this->details = details;
+            MarkDirty(Field::Details);
+        }
+        std::string GetDetails() const {
+            return details;
+        }
+
+        void SetState(std::string state) {
+            this->state = state;
+            MarkDirty(Field::State);
+        }
+        std::string GetState() const {
+            return state;
+        }
+
+        std::shared_ptr<Timestamps> GetTimestamps() {
+            return timestamps;
+        }
+
+        void SetParty(std::shared_ptr<Party> party) {
+            this->party = party;
+            MarkDirty(Field::Party);
+        }
+        /**
+         * Note: Party is std::nullopt by default
+         */
+        std::shared_ptr<Party> GetParty() {
+            return party != nullptr ? party : nullptr;
+        }
+
+        std::shared_ptr<Assets> GetAssets() {
+            return assets;
+        }
+
+        void AddButton(std::shared_ptr<Button> button) {
+            assert(buttons.size() < 2);
+            buttons.emplace_back(button);
+            MarkDirty(Field::Buttons);
+        }
+
+        void ClearButtons() {
+            buttons.clear();
+            MarkDirty(Field::Buttons);
+        }
+
+        /**
+         * @brief Deep copy which reuses this activity's strings and sub-objects, so copying over a
+         * previous copy of similar size does not allocate. The copy shares no sub-objects with other
+         */
+        void CopyFrom(const Activity& other) {
+            client_id = other.client_id;
+            name = other.name;
+            type = other.type;
+            details = other.details;
+            state = other.state;
+            *timestamps = *other.timestamps;
+            *assets = *other.assets;
+
+            if (other.party == nullptr) party = nullptr;
+            else if (party == nullptr) party = std::make_shared<Party>(*other.party);
+            else *party = *other.party;
+
+            buttons.resize(other.buttons.size());
+            for (size_t i = 0; i < buttons.size(); i++) {
+                if (buttons[i] == nullptr) buttons[i] = std::make_shared<Button>(*other.buttons[i]);
+                else *buttons[i] = *other.buttons[i];
+            }
+
+            cache.dirty = all_fields;
+        }
+
+        static constexpr auto JsonFields() {
+            constexpr auto empty = [](const std::string& value) { return value.empty(); };
+            return std::make_tuple(
+                JSON::Field { "\"name\":", &Activity::name, empty },
+                JSON::Field { "\"client_id\":", &Activity::client_id, [](const uint64_t& id) { return id == 0; } },
+                JSON::Field { "\"type\":", &Activity::type },
+                JSON::Field { "\"details\":", &Activity::details, empty },
+                JSON::Field { "\"state\":", &Activity::state, empty },
+                JSON::Field { "\"timestamps\":", &Activity::timestamps, [](const std::shared_ptr<Timestamps>& timestamps) {
+                    return timestamps->GetStart() <= 0 && timestamps->GetEnd() <= 0;
+                } },
+                JSON::Field { "\"party\":", &Activity::party, [](const std::shared_ptr<Party>& party) { return party == nullptr; } },
+                JSON::Field { "\"assets\":", &Activity::assets, [](const std::shared_ptr<Assets>& assets) { return assets->IsEmpty(); } },
+                JSON::Field { "\"buttons\":", &Activity::buttons, [](const std::vector<std::shared_ptr<Button>>& buttons) { return buttons.empty(); } }
+            );
+        }
+
+        /**
+         * @brief Writes the activity from cached fragments, re-rendering only the fields which changed
+         * since the last call. Another thread serializing the same activity at the same time renders in full
+         */
+        void ToJson(JSON::JsonWriter* writer) const {
+            std::unique_lock lock(cache.mutex, std::try_to_lock);
+            if (!lock.owns_lock()) {
+                JSON::Serialize(writer, *this);
+                return;
+            }
+
+            constexpr auto fields = JsonFields();
+            bool changed = false;
+            [&]<size_t... I>(std::index_sequence<I...>) {
+                (RefreshFragment<I>(std::get<I>(fields), &changed), ...);
+            }(std::make_index_sequence<std::tuple_size_v<decltype(fields)>>());
+            cache.dirty = 0;
+
+            if (changed) {
+                cache.rendered.assign("{");
+                for (const auto& fragment : cache.fragments) {
+                    if (fragment.empty()) continue;
+                    if (cache.rendered.size() > 1) cache.rendered.push_back(',');
+                    cache.rendered.append(fragment);
+                }
+                cache.rendered.push_back('}');
+            }
+
+            writer->WriteRaw(cache.rendered);
+        }
+
+        /**
+         * @brief Equal for activities which serialize the same, barring collisions
+         */
+        uint64_t Hash() const {
+            StructuralHash hash;
+            hash.Add(client_id).Add(name).Add(type).Add(details).Add(state);
+            hash.Add(timestamps->Hash()).Add(assets->Hash());
+            hash.Add(party != nullptr).Add(party != nullptr ? party->Hash() : 0);
+            hash.Add(buttons.size());
+            for (const auto& button : buttons) hash.Add(button->Hash());
+            return hash.Value();
+        }
+    private:
+        uint64_t client_id = 0;
+        std::string name;
+        ActivityType type = ActivityType::Playing;
+        std::string details;
+        std::string state;
+        std::shared_ptr<Timestamps> timestamps = std::make_shared<Timestamps>();
+        std::shared_ptr<Party> party = nullptr;
+        std::shared_ptr<Assets> assets = std::make_shared<Assets>();
+        std::vector<std::shared_ptr<Button>> buttons;
+
+        // Positions in JsonFields, which are also the dirty bits
+        enum class Field : uint32_t { Name, ClientId, Type, Details, State, Timestamps, Party, Assets, Buttons, Count };
+        static constexpr uint32_t all_fields = (1u << std::to_underlying(Field::Count)) - 1;
+
+        /**
+         * @brief Rendered "key":value fragments by field. Copies start out empty so they never share it
+         */
+        struct Cache {
+            Cache() = default;
+            Cache(const Cache&) {}
+            Cache& operator=(const Cache&) {
+                dirty = all_fields;
+                return *this;
+            }
+
+            std::mutex mutex;
+            uint32_t dirty = all_fields;
+            std::array<uint64_t, std::to_underlying(Field::Count)> revisions {}; // of the sub-objects rendered
+            std::array<std::string, std::to_underlying(Field::Count)> fragments;
+            std::string rendered;
+            JSON::JsonWriter scratch;
+        };
+        mutable Cache cache;
+
+        void MarkDirty(Field field) {
+            cache.dirty |= 1u << std::to_underlying(field);
+        }
+
+        /**
+         * @brief Sub-objects are edited through their own setters, so their revisions stand in for dirty bits
+         */
+        uint64_t Revision(Field field) const {
+            switch (field) {
+            case Field::Timestamps:
+                return timestamps->GetRevision();
+            case Field::Party:
+                return party != nullptr ? party->GetRevision() : 0;
+            case Field::Assets:
+                return assets->GetRevision();
+            case Field::Buttons: {
+                StructuralHash hash;
+                for (const auto& button : buttons) hash.Add(button->GetRevision());
+                return hash.Value();
+            }
+            default:
+                return 0;
+            }
+        }
 
-          Result result;
-          if (result = ReadBytes(&op_code_bytes, peek); result != Result::Ok) return result;
-          if (result = ReadBytes(&msg_len_bytes, peek); result != Result::Ok) return result;
+        template<size_t I, typename F>
+        void RefreshFragment(const F& field, bool* changed) const {
+            constexpr Field id = static_cast<Field>(I);
+            uint64_t revision = Revision(id);
+            if ((cache.dirty & (1u << I)) == 0 && cache.revisions[I] == revision) return;
 
-          msg->op_code = std::bit_cast<uint32_t>(op_code_bytes);
-          uint32_t msg_len = std::bit_cast<uint32_t>(msg_len_bytes);
+            cache.revisions[I] = revision;
+            *changed = true;
 
-          if (peek) {
-            int msg_size;
-            ioctl(socketfd, FIONREAD, &msg_size);
+            const auto& value = this->*field.member;
+            if (field.skip != nullptr && field.skip(value)) {
+                cache.fragments[I].clear();
+                return;
+            }
 
-            if (msg_size == 0)
-              return Result::ReadPipeNoData;
-          }
+            cache.scratch.Reset();
+            cache.scratch.WriteRaw(field.key);
+            cache.scratch.Write(value);
+            cache.fragments[I].assign(cache.scratch.View());
+        }
+    };
 
-          std::vector<char> buffer(msg_len);
-          int bytes_read = read(socketfd, buffer.data(), msg_len);
-          if (bytes_read != (int)msg_len) return Result::ReadPipeFailed;
+    struct TemplateValue {
+        std::string_view name;
+        std::string_view value;
+    };
 
-          msg->message = std::string(buffer.begin(), buffer.end());
+    /**
+     * @brief An activity rendered once, with {name} placeholders in its strings filled in for each update
+     * by splicing the values between the pre-rendered pieces. Immutable, so it can be shared by threads
+     */
+    class ActivityTemplate {
+    public:
+        explicit ActivityTemplate(const Activity& activity) {
+            JSON::JsonWriter writer;
+            JSON::Serialize(&writer, activity);
+            std::string_view rendered = writer.View();
+
+            // Placeholders can only be inside strings, where a brace needs no escaping
+            bool in_string = false;
+            size_t literal_start = 0;
+            for (size_t i = 0; i < rendered.size(); i++) {
+                char c = rendered[i];
+                if (c == '\\') {
+                    i++;
+                } else if (c == '"') {
+                    in_string = !in_string;
+                } else if (c == '{' && in_string) {
+                    size_t end = i + 1;
+                    while (end < rendered.size() && IsNameChar(rendered[end])) end++;
+                    if (end == i + 1 || end == rendered.size() || rendered[end] != '}') continue;
+
+                    literals.emplace_back(rendered.substr(literal_start, i - literal_start));
+                    names.emplace_back(rendered.substr(i + 1, end - i - 1));
+                    literal_start = end + 1;
+                    i = end;
+                }
+            }
+            literals.emplace_back(rendered.substr(literal_start));
 
-          std::smatch match;
-          if (std::regex_search(msg->message, match, nonce_re))
-            msg->nonce = match.str(1);
+            hash = StructuralHash().Add(rendered).Value();
+            for (const auto& literal : literals) size_hint += literal.size();
+        }
 
-          return Result::Ok;
+        /**
+         * @brief Placeholder names in order of appearance, repeats included
+         */
+        std::span<const std::string> GetPlaceholders() const {
+            return names;
         }
 
-        Result Write(uint32_t op_code, std::string message) override {
-          uint32_t length = static_cast<uint32_t>(message.length());
+        /**
+         * @brief Writes the activity JSON. Placeholders missing from values are kept as they were written,
+         * braces included
+         */
+        void Render(JSON::JsonWriter* writer, std::span<const TemplateValue> values) const {
+            for (size_t i = 0; i < names.size(); i++) {
+                writer->WriteRaw(literals[i]);
+                if (const auto* value = Find(values, names[i])) {
+                    writer->WriteEscaped(value->value);
+                } else {
+                    writer->WriteRaw("{");
+                    writer->WriteRaw(names[i]);
+                    writer->WriteRaw("}");
+                }
+            }
+            writer->WriteRaw(literals.back());
+        }
 
-          std::vector<char> buffer(8 + length);
-          std::memcpy(buffer.data(), &op_code, 4);
-          std::memcpy(buffer.data() + 4, &length, 4);
-          std::memcpy(buffer.data() + 8, message.data(), length);
+        /**
+         * @brief Equal for equal values, so repeated updates can be recognized without rendering
+         */
+        uint64_t Hash(std::span<const TemplateValue> values) const {
+            StructuralHash result;
+            result.Add(hash);
+            for (const auto& name : names) {
+                // A missing value renders differently from an empty one
+                const auto* value = Find(values, name);
+                result.Add(value != nullptr).Add(value != nullptr ? value->value : std::string_view());
+            }
+            return result.Value();
+        }
 
-          return write(socketfd, buffer.data(), buffer.size()) < 0 ? Result::WritePipeFailed : Result::Ok;
+        /**
+         * @brief Bytes of the rendered activity apart from the values
+         */
+        size_t SizeHint() const {
+            return size_hint;
+        }
+    private:
+        static bool IsNameChar(char c) {
+            return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_';
         }
 
-        bool IsOpen() override {
-          return socketfd != 0;
+        static const TemplateValue* Find(std::span<const TemplateValue> values, std::string_view name) {
+            auto found = std::ranges::find(values, name, &TemplateValue::name);
+            return found != values.end() ? &*found : nullptr;
         }
-      private:
-        int socketfd;
-    };
 
-    #endif
+        std::vector<std::string> literals; // one more than names
+        std::vector<std::string> names;
+        uint64_t hash = 0;
+        size_t size_hint = 0;
+    };
 
-    #pragma region Activity Types
+    #pragma endregion
 
-    class Timestamps : public JSON::JsonSerializable {
+    /**
+     * @brief Holds values under compact ids. An id combines a slot index with the slot's generation,
+     * which changes every time the slot is freed, so stale or forged ids never reach a reused slot.
+     */
+    template<typename T>
+    class SlotTable {
     public:
-        void SetStart(int64_t seconds) { start = seconds; }
-        void SetEnd(int64_t seconds) { end = seconds; }
-        int64_t GetStart() const { return start; }
-        int64_t GetEnd() const { return end; }
+        uint64_t Insert(T value) {
+            uint32_t index;
+            if (!free_slots.empty()) {
+                index = free_slots.back();
+                free_slots.pop_back();
+            } else {
+                index = static_cast<uint32_t>(slots.size());
+                slots.emplace_back();
+            }
 
-        void ToJson(JSON::JsonWriter* writer) const override {
-            writer->BeginObject();
-            if (start > 0) writer->Put("start", start);
-            if (end > 0) writer->Put("end", end);
-            writer->EndObject();
+            Slot& slot = slots[index];
+            slot.occupied = true;
+            slot.value = std::move(value);
+            size++;
+            return (static_cast<uint64_t>(slot.generation) << 32) | index;
         }
-    private:
-        int64_t start = 0;
-        int64_t end = 0;
-    };
 
-    class Party : public JSON::JsonSerializable {
-    public:
-        void SetId(std::string id) {
-            this->id = id;
-        }
-        std::string GetId() {
-            return id;
+        /**
+         * @return The value stored under id, or nullptr
+         */
+        T* Find(uint64_t id) {
+            uint32_t index = static_cast<uint32_t>(id);
+            uint32_t generation = static_cast<uint32_t>(id >> 32);
+            if (index >= slots.size() || !slots[index].occupied || slots[index].generation != generation)
+                return nullptr;
+            return &slots[index].value;
         }
 
         /**
-         * @param size Must be greater equals 0
+         * @brief Removes and returns the value stored under id
          */
-        void SetCurrentSize(int size) {
-            assert(size >= 0);
-            current_size = size;
+        std::optional<T> Take(uint64_t id) {
+            uint32_t index = static_cast<uint32_t>(id);
+            uint32_t generation = static_cast<uint32_t>(id >> 32);
+            if (index >= slots.size() || !slots[index].occupied || slots[index].generation != generation)
+                return std::nullopt;
+
+            Slot& slot = slots[index];
+            std::optional<T> value = std::move(slot.value);
+            slot.value = T();
+            slot.occupied = false;
+            slot.generation++;
+            free_slots.push_back(index);
+            size--;
+            return value;
         }
-        int GetCurrentSize() const {
-            return current_size;
+
+        size_t Size() const {
+            return size;
         }
 
         /**
-         * @param size Must be greater equals 0 and the current size
+         * @brief Calls f(id, value) for every value held. f must not insert or take values
          */
-        void SetMaxSize(int size) {
-            assert(size >= 0 && size >= current_size);
-            max_size = size;
-        }
-        int GetMaxSize() const {
-            return max_size;
+        template<typename F>
+        void ForEach(F f) {
+            for (uint32_t index = 0; index < slots.size(); index++) {
+                Slot& slot = slots[index];
+                if (slot.occupied) f((static_cast<uint64_t>(slot.generation) << 32) | index, slot.value);
+            }
         }
+    private:
+        struct Slot {
+            T value {};
+            uint32_t generation = 1;
+            bool occupied = false;
+        };
 
-        void ToJson(JSON::JsonWriter* writer) const override {
-            writer->BeginObject();
+        std::vector<Slot> slots;
+        std::vector<uint32_t> free_slots;
+        size_t size = 0;
+    };
 
-            if (id.length() > 0)
-                writer->Put("id", id);
+    /**
+     * @brief Bounded lock-free queue for many producers and a single consumer. All cells are allocated up
+     * front; the sequence number in each cell says whether it is free to write or ready to read
+     */
+    template<typename T>
+    class MpscQueue {
+    public:
+        explicit MpscQueue(size_t capacity)
+            : size(std::bit_ceil(std::max<size_t>(capacity, 2))), cells(std::make_unique<Cell[]>(size)) {
+            for (size_t i = 0; i < size; i++)
+                cells[i].sequence.store(i, std::memory_order_relaxed);
+        }
 
-            if (current_size != 0 || max_size != 0)
-                writer->Put("size", std::vector<JSON::JsonValue> {current_size, max_size});
+        /**
+         * @brief Safe from any thread
+         * @return false if the queue is full, in which case value is left as it was
+         */
+        bool TryPush(T& value) {
+            size_t position = tail.load(std::memory_order_relaxed);
+            while (true) {
+                Cell& cell = cells[position & (size - 1)];
+                size_t sequence = cell.sequence.load(std::memory_order_acquire);
+                auto lag = static_cast<std::ptrdiff_t>(sequence - position);
+
+                if (lag == 0) {
+                    if (tail.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                        cell.value = std::move(value);
+                        cell.sequence.store(position + 1, std::memory_order_release);
+                        return true;
+                    }
+                } else if (lag < 0) {
+                    return false;
+                } else {
+                    position = tail.load(std::memory_order_relaxed);
+                }
+            }
+        }
 
-            writer->EndObject();
+        /**
+         * @brief Consumer thread only
+         */
+        std::optional<T> TryPop() {
+            Cell& cell = cells[head & (size - 1)];
+            if (cell.sequence.load(std::memory_order_acquire) != head + 1)
+                return std::nullopt;
+
+            std::optional<T> value = std::move(cell.value);
+            cell.value = T();
+            cell.sequence.store(head + size, std::memory_order_release);
+            head++;
+            return value;
         }
     private:
-        std::string id;
-        int current_size = 0;
-        int max_size = 0;
+        struct Cell {
+            std::atomic<size_t> sequence;
+            T value;
+        };
+
+        size_t size;
+        std::unique_ptr<Cell[]> cells;
+        alignas(64) std::atomic<size_t> tail = 0;
+        alignas(64) size_t head = 0;
     };
 
-    class Assets : public JSON::JsonSerializable {
+    /**
+     * @brief Holds the newest value from one writer for one reader, using three buffers so neither
+     * side ever waits for the other. Values the reader did not get to in time are skipped
+     */
+    template<typename T>
+    class LatestSlot {
     public:
-        void SetLargeImage(std::string image) {
-            large_image = image;
-        }
-        std::string GetLargeImage() const {
-            return large_image;
+        /**
+         * @brief Writer only. The buffer to fill before calling Publish
+         */
+        T& Back() {
+            return buffers[back];
         }
 
-        void SetLargeImageText(std::string text) {
-            large_text = text;
-        }
-        std::string GetLargeImageText() const {
-            return large_text;
+        /**
+         * @brief Writer only. Makes the back buffer the newest value
+         * @return true if the reader had already taken the value this one replaces
+         */
+        bool Publish() {
+            uint8_t previous = middle.exchange(back | fresh, std::memory_order_acq_rel);
+            back = previous & index_mask;
+            return (previous & fresh) == 0;
         }
 
-        void SetSmallImage(std::string image) {
-            small_image = image;
-        }
-        std::string GetSmallImage() const {
-            return small_image;
+        /**
+         * @brief Reader only. Whether Take would return a value
+         */
+        bool Pending() const {
+            return (middle.load(std::memory_order_relaxed) & fresh) != 0;
         }
 
-        void SetSmallImageText(std::string text) {
-            small_text = text;
-        }
-        std::string GetSmallImageText() const {
-            return small_text;
+        /**
+         * @brief Reader only
+         * @return The newest value if it was not taken yet, valid until the next call
+         */
+        T* Take() {
+            if (!Pending()) return nullptr;
+
+            uint8_t previous = middle.exchange(front, std::memory_order_acq_rel);
+            front = previous & index_mask;
+            return &buffers[front];
         }
+    private:
+        static constexpr uint8_t index_mask = 3;
+        static constexpr uint8_t fresh = 4;
 
-        void ToJson(JSON::JsonWriter* writer) const override {
-            writer->BeginObject();
+        std::array<T, 3> buffers;
+        alignas(64) uint8_t back = 0;
+        alignas(64) std::atomic<uint8_t> middle = 1;
+        alignas(64) uint8_t front = 2;
+    };
 
-            if (large_image.length() > 0)
-                writer->Put("large_image", large_image);
+    /**
+     * @brief Allows bursts of up to capacity events and one more per refill interval after that.
+     * A capacity of 0 allows everything
+     */
+    class TokenBucket {
+    public:
+        using Clock = std::chrono::steady_clock;
 
-            if (large_text.length() > 0)
-                writer->Put("large_text", large_text);
+        TokenBucket(uint32_t capacity, std::chrono::milliseconds refill)
+            : capacity(capacity), refill(std::max(refill, std::chrono::milliseconds(1))), tokens(capacity) {}
 
-            if (small_image.length() > 0)
-                writer->Put("small_image", small_image);
+        bool TryTake(Clock::time_point now = Clock::now()) {
+            if (capacity == 0) return true;
 
-            if (small_text.length() > 0)
-                writer->Put("small_text", small_text);
-            
-            writer->EndObject();
+            Refill(now);
+            if (tokens == 0) return false;
+            if (tokens == capacity) last_refill = now; // a full bucket does not bank time
+            tokens--;
+            return true;
         }
-    private:
-        std::string large_image;
-        std::string large_text;
-        std::string small_image;
-        std::string small_text;
-    };
 
-    class Button : public JSON::JsonSerializable {
-    public:
-        Button(std::string label, std::string url) {
-            SetLabel(label);
-            SetUrl(url);
-        }
+        /**
+         * @brief When TryTake will succeed next
+         */
+        Clock::time_point NextToken(Clock::time_point now = Clock::now()) {
+            if (capacity == 0) return now;
 
-        void SetLabel(std::string label) {
-            assert(label.length() < 32);
-            this->label = label;
-        }
-        std::string GetLabel() const {
-            return label;
+            Refill(now);
+            return tokens > 0 ? now : last_refill + refill;
         }
+    private:
+        void Refill(Clock::time_point now) {
+            if (tokens == capacity) return;
 
-        void SetUrl(std::string url) {
-            assert(url.length() < 512);
-            this->url = url;
-        }
-        std::string GetUrl() const {
-            return url;
-        }
+            auto earned = (now - last_refill) / refill;
+            if (earned <= 0) return;
 
-        void ToJson(JSON::JsonWriter* writer) const override {
-            writer->BeginObject();
-            writer->Put("label", label);
-            writer->Put("url", url);
-            writer->EndObject();
+            if (static_cast<uint64_t>(earned) >= capacity - tokens) {
+                tokens = capacity;
+            } else {
+                tokens += static_cast<uint32_t>(earned);
+                last_refill += earned * refill;
+            }
         }
-    private:
-        std::string label;
-        std::string url;
+
+        uint32_t capacity;
+        Clock::duration refill;
+        uint32_t tokens;
+        Clock::time_point last_refill;
     };
 
-    enum class ActivityType {
-        Playing = 0,
-        Listening = 2,
-        Watching = 3,
-        Competing = 5
+    struct ClientSettings {
+        bool auto_reconnect = true;
+        uint64_t reconnect_timeout_ms = 5000;
+        /**
+         * @brief How long a pipe waits for Discord to answer the handshake. Read when the pipes are created
+         */
+        uint64_t handshake_timeout_ms = 5000;
+        /**
+         * @brief Keep a connection to every running Discord instance (Stable, PTB, Canary, ...) and send
+         * each of them the same frames. Read on the first Connect
+         */
+        bool fan_out = false;
+        /**
+         * @brief Creates the transport for an instance number, or for any instance if it is -1.
+         * Defaults to the platform's Discord pipe
+         */
+        std::function<std::shared_ptr<Pipe>(int instance)> pipe_factory;
+        /**
+         * @brief Requests that can wait for the I/O thread before submitting fails with QueueFull.
+         * Read when the client is constructed
+         */
+        size_t submit_queue_capacity = 1024;
+        /**
+         * @brief Activity updates sent back to back before the limit kicks in, 0 to send everything
+         * at once. Discord drops updates beyond about 5 per 20 seconds. While limited only the newest
+         * update is kept; the ones it replaces complete with Superseded. Read when the client is constructed
+         */
+        uint32_t rate_limit_burst = 5;
+        uint64_t rate_limit_refill_ms = 4000;
+        /**
+         * @brief How long a published activity may go unanswered before PublishActivity sends the next one anyway
+         */
+        uint64_t publish_timeout_ms = 5000;
     };
 
-    class Activity : public JSON::JsonSerializable {
+    class Client {
     public:
+        Client(uint64_t client_id) : Client(client_id, ClientSettings()) {}
+        Client(uint64_t client_id, ClientSettings settings)
+            : settings(std::move(settings)),
+              client_id(client_id),
+              submissions(this->settings.submit_queue_capacity),
+              rate_limit(this->settings.rate_limit_burst, std::chrono::milliseconds(this->settings.rate_limit_refill_ms)) {}
+
         /**
-         * @brief Set the client/application id
-         * @param client_id 0 = use id from client
+         * @brief Connects every pipe that is not open yet. While Run is running this happens on the Run
+         * thread and the call waits for it
+         * @return Ok if at least one pipe is open afterwards
          */
-        void SetClientId(uint64_t client_id) {
-            this->client_id = client_id;
-        }
-        uint64_t GetClientId() const {
-            return this->client_id;
+        Result Connect() {
+            return OnRunThread([this] { return ConnectPipes(); });
         }
 
         /**
-         * @brief Sets the name of the activity
-         * @param name Length must be greater than 0
+         * @brief Closes every pipe. Requests still waiting for an answer complete with Result::PipeNotOpen.
+         * While Run is running this happens on the Run thread and the call waits for it
          */
-        void SetName(std::string name) {
-            assert(name.length() > 0);
-            this->name = name;
+        Result Disconnect() {
+            return OnRunThread([this] { return DisconnectPipes(); });
         }
-        std::string GetName() const {
-            return name;
+
+        Result Reconnect() {
+            return OnRunThread([this] {
+                if (Result result = DisconnectPipes(); result != Result::Ok) return result;
+                return ConnectPipes();
+            });
         }
 
-        void SetType(ActivityType type) {
-            this->type = type;
+        void UpdateActivity(const std::shared_ptr<Activity> activity, ResultCallback callback) {
+            std::optional<uint64_t> hash;
+            if (activity != nullptr) hash = activity->Hash();
+
+            Submit(SetActivity([&](IpcFrameWriter& writer) { writer.Write(activity); }, 512, hash, std::move(callback)));
         }
-        ActivityType GetType() const {
-            return type;
+
+        /**
+         * @brief Sends the template with its placeholders replaced by values. Nothing but the values is serialized
+         */
+        void UpdateActivity(const ActivityTemplate& activity_template, std::span<const TemplateValue> values, ResultCallback callback) {
+            size_t capacity = activity_template.SizeHint() + 128;
+            for (const auto& value : values) capacity += value.value.size();
+
+            Submit(SetActivity(
+                [&](IpcFrameWriter& writer) { activity_template.Render(&writer, values); },
+                capacity,
+                activity_template.Hash(values),
+                std::move(callback)
+            ));
         }
 
-        void SetDetails(std::string details) {
-            this->details = details;
+        /**
+         * @brief Takes the values as a braced list, e.g. {{"score", "1200"}}
+         */
+        void UpdateActivity(const ActivityTemplate& activity_template, std::initializer_list<TemplateValue> values, ResultCallback callback) {
+            UpdateActivity(activity_template, std::span<const TemplateValue>(values.begin(), values.size()), std::move(callback));
         }
-        std::string GetDetails() const {
-            return details;
+
+        /**
+         * @brief Makes a copy of activity the one to show, without blocking or serializing anything, so it
+         * can be called every frame. The Run thread sends only the newest published activity, once Discord
+         * answered the previous one. Call from one thread at a time; failures go to the log callback
+         */
+        void PublishActivity(const Activity& activity) {
+            published.Back().CopyFrom(activity);
+            if (published.Publish()) reactor.Wake();
         }
 
-        void SetState(std::string state) {
-            this->state = state;
+        void ClearActivity(ResultCallback callback) {
+            auto submission = SetActivity([](IpcFrameWriter& writer) {
+                // Make an empty object
+                writer.BeginObject();
+                writer.EndObject();
+            }, 0, std::nullopt, std::move(callback));
+
+            submission.reusable = false;
+            Submit(std::move(submission));
         }
-        std::string GetState() const {
-            return state;
+
+        Result Run() {
+            Result result;
+            auto next_reconnect = std::chrono::steady_clock::now();
+            run_thread.store(std::this_thread::get_id(), std::memory_order_release);
+
+            while (true) {
+                wakeups.fetch_add(1, std::memory_order_relaxed);
+                TakeSubmissions();
+
+                if (retry.joinable() && retry_done.load(std::memory_order_acquire)) {
+                    FinishRetry();
+                    next_reconnect = std::chrono::steady_clock::now() + std::chrono::milliseconds(settings.reconnect_timeout_ms);
+                }
+
+                if (OpenCount() == 0) {
+                    if (!settings.auto_reconnect) {
+                        // Until a posted Connect wakes the loop
+                        reactor.Wait(-1);
+                        continue;
+                    }
+
+                    if (auto now = std::chrono::steady_clock::now(); now < next_reconnect) {
+                        reactor.Wait(static_cast<int>(std::chrono::ceil<std::chrono::milliseconds>(next_reconnect - now).count()));
+                        continue;
+                    }
+
+                    log_callback(Result::PipeNotOpen, LogLevel::Error, "Pipe handle is invalid. Attempting to reconnect", nullptr);
+
+                    if (result = ConnectPipes(); result == Result::Ok) {
+                        log_callback(Result::Ok, LogLevel::Info, "Reconnected", nullptr);
+                    } else {
+                        log_callback(result, LogLevel::Error, "Failed to reconnect", nullptr);
+                        next_reconnect = std::chrono::steady_clock::now() + std::chrono::milliseconds(settings.reconnect_timeout_ms);
+                    }
+
+                    continue;
+                }
+
+                int timeout_ms = -1;
+
+                // Instances that are not running are looked for again on another thread while the others
+                // are served. The retry wakes the loop once it is done
+                if (settings.fan_out && settings.auto_reconnect && OpenCount() < connections.size() && !retry.joinable()) {
+                    auto now = std::chrono::steady_clock::now();
+                    if (now >= next_reconnect) StartRetry();
+                    else timeout_ms = static_cast<int>(std::chrono::ceil<std::chrono::milliseconds>(next_reconnect - now).count());
+                }
+
+                FlushOutgoing();
+
+                // Rate limited updates go out when the next token frees up, and a published activity waiting
+                // on an unanswered one once that one times out
+                if (deferred || published.Pending()) {
+                    auto now = TokenBucket::Clock::now();
+                    auto ready = rate_limit.NextToken(now);
+                    if (!deferred && publish_in_flight) ready = std::max(ready, publish_deadline);
+                    int wait_ms = std::max(0, static_cast<int>(std::chrono::ceil<std::chrono::milliseconds>(ready - now).count()));
+                    timeout_ms = timeout_ms < 0 ? wait_ms : std::min(timeout_ms, wait_ms);
+                }
+
+                // Pipes without a pollable handle are checked every 100ms as before
+                bool polled = std::ranges::any_of(connections, [](const Connection& connection) {
+                    return !connection.watched && connection.IsLive();
+                });
+                if (polled) timeout_ms = timeout_ms < 0 ? 100 : std::min(timeout_ms, 100);
+
+                auto readiness = reactor.Wait(timeout_ms);
+                for (size_t i = 0; i < connections.size(); i++) {
+                    if (!connections[i].IsLive()) continue;
+
+                    bool hangup = (readiness.hangup >> i) & 1;
+                    if (((readiness.readable >> i) & 1) || hangup || !connections[i].watched)
+                        DrainIncoming(i);
+
+                    if (hangup && connections[i].IsLive()) {
+                        log_callback(Result::ReadPipeFailed, LogLevel::Error, "Pipe was closed by the other end", nullptr);
+                        ClosePipe(i, Result::ReadPipeFailed);
+                    }
+                }
+            }
+
+            return Result::Ok;
         }
 
-        std::shared_ptr<Timestamps> GetTimestamps() {
-            return timestamps;
+        void SetLogCallback(LogCallback callback) {
+            log_callback = callback;
+        }
+
+        void SetEventCallback(std::function<void(Event event)> callback) {
+            event_callback = callback;
         }
 
-        void SetParty(std::shared_ptr<Party> party) {
-            this->party = party;
+        ClientSettings& GetSettings() {
+            return settings;
         }
+
         /**
-         * Note: Party is std::nullopt by default
+         * @brief Updates that were not sent because Discord already showed the same activity
          */
-        std::shared_ptr<Party> GetParty() {
-            return party != nullptr ? party : nullptr;
-        }
-
-        std::shared_ptr<Assets> GetAssets() {
-            return assets;
+        uint64_t GetSuppressedUpdates() const {
+            return suppressed_updates.load(std::memory_order_relaxed);
         }
 
-        void AddButton(std::shared_ptr<Button> button) {
-            assert(buttons.size() < 2);
-            buttons.emplace_back(button);
+        /**
+         * @brief Passes through the Run loop, each after waiting on the pipes. Tells how often an idle client wakes up
+         */
+        uint64_t GetWakeups() const {
+            return wakeups.load(std::memory_order_relaxed);
         }
+    private:
+        /**
+         * @brief One Discord instance and the frames on their way to it
+         */
+        struct Connection {
+            std::shared_ptr<Pipe> pipe;
+            bool ready = false; // handshake done
+            bool watched = false;
+            bool watching_writes = false;
+            std::vector<std::shared_ptr<const IpcFrame>> sending;
+            size_t sent_bytes = 0; // written bytes of sending.front()
+            size_t owed = 0; // requests queued or written on this connection and not answered yet
+
+            bool IsLive() const {
+                return ready && pipe->IsOpen();
+            }
+        };
 
-        void ClearButtons() {
-            buttons.clear();
-        }
+        /**
+         * @brief A request sent to one or more connections. The callback runs once all of them answered
+         */
+        struct PendingRequest {
+            ResultCallback callback;
+            uint64_t owed = 0; // bit N is set until connection N answered
+            std::shared_ptr<const IpcFrame> frame; // reported when a connection closes without answering
+            Result result = Result::Ok;
+            IpcMessage failure;
+        };
 
-        void ToJson(JSON::JsonWriter* writer) const override {
-            writer->BeginObject();
+        std::shared_ptr<Pipe> CreatePipe(int instance) {
+            std::shared_ptr<Pipe> pipe;
+            if (settings.pipe_factory) {
+                pipe = settings.pipe_factory(instance);
+            } else {
+                #if _WIN32
+                pipe = std::make_shared<WindowsPipe>(std::max(instance, 0));
+                #else
+                pipe = std::make_shared<UnixPipe>(instance);
+                #endif
+            }
 
-            if (name.length() > 0)
-                writer->Put("name", name);
+            pipe->SetHandshakeTimeout(std::chrono::milliseconds(settings.handshake_timeout_ms));
+            return pipe;
+        }
 
-            if (client_id != 0)
-                writer->Put("client_id", client_id);
+        void CreateConnections() {
+            if (!settings.fan_out) {
+                connections.emplace_back().pipe = CreatePipe(-1);
+                return;
+            }
 
-            writer->Put("type", static_cast<int>(type));
+            // Discord numbers its instances discord-ipc-0 to discord-ipc-9
+            for (int instance = 0; instance < 10; instance++)
+                connections.emplace_back().pipe = CreatePipe(instance);
+        }
 
-            if (details.length() > 0)
-                writer->Put("details", details);
+        size_t OpenCount() {
+            return std::ranges::count_if(connections, [](const Connection& connection) { return connection.IsLive(); });
+        }
 
-            if (state.length() > 0)
-                writer->Put("state", state);
+        /**
+         * @brief Handshakes with the connections that were not open
+         */
+        struct HandshakeBatch {
+            std::string handshake;
+            std::vector<size_t> indices;
+            std::vector<std::shared_ptr<Pipe>> pipes;
+            std::vector<IpcMessage> replies;
+            std::vector<Result> results;
+
+            /**
+             * @brief Opens the pipes and waits for their dispatch events. Several instances shake hands side
+             * by side so a slow one does not hold up the others. Touches nothing but the pipes, so it may run
+             * on any thread
+             */
+            void Run() {
+                replies.assign(pipes.size(), IpcMessage());
+                results.assign(pipes.size(), Result::OpenPipeFailed);
+                if (pipes.size() == 1) {
+                    results[0] = pipes[0]->Handshake(handshake, &replies[0]);
+                    return;
+                }
 
-            writer->Put("timestamps", timestamps);
-            
-            if (party != nullptr)
-                writer->Put("party", party);
+                std::vector<std::future<Result>> handshakes;
+                for (size_t i = 0; i < pipes.size(); i++) {
+                    handshakes.push_back(std::async(std::launch::async, [this, i] {
+                        return pipes[i]->Handshake(handshake, &replies[i]);
+                    }));
+                }
+                for (size_t i = 0; i < pipes.size(); i++) results[i] = handshakes[i].get();
+            }
+        };
 
-            writer->Put("assets", assets);
-            
-            std::vector<JSON::JsonValue> j_buttons;
-            for (const auto& btn : buttons)
-                j_buttons.emplace_back(btn);
+        HandshakeBatch PrepareHandshakes() {
+            IpcFrameWriter writer(0, 64);
+            writer.BeginObject();
+            writer.Put("v", 1);
 
-            if (j_buttons.size() > 0)
-                writer->Put("buttons", j_buttons);
+            // The handshake expects the id as a string
+            char client_id_chars[20];
+            auto [client_id_end, ec] = std::to_chars(client_id_chars, std::end(client_id_chars), client_id);
+            writer.PendMember("client_id");
+            writer.WriteString(std::string_view(client_id_chars, client_id_end));
+            writer.EndObject();
 
-            writer->EndObject();
+            HandshakeBatch batch;
+            batch.handshake = writer.Finish();
+            for (size_t i = 0; i < connections.size(); i++) {
+                if (connections[i].IsLive()) continue;
+                batch.indices.push_back(i);
+                batch.pipes.push_back(connections[i].pipe);
+            }
+            return batch;
         }
-    private:
-        uint64_t client_id = 0;
-        std::string name;
-        ActivityType type = ActivityType::Playing;
-        std::string details;
-        std::string state;
-        std::shared_ptr<Timestamps> timestamps = std::make_shared<Timestamps>();
-        std::shared_ptr<Party> party = nullptr;
-        std::shared_ptr<Assets> assets = std::make_shared<Assets>();
-        std::vector<std::shared_ptr<Button>> buttons;
-    };
 
-    #pragma endregion
+        /**
+         * @return The most telling failure, for when no pipe could be opened
+         */
+        Result AcceptHandshakes(const HandshakeBatch& batch) {
+            Result result = Result::OpenPipeFailed;
+            for (size_t i = 0; i < batch.indices.size(); i++) {
+                if (Result accepted = Accept(batch.indices[i], batch.results[i], batch.replies[i]); result == Result::OpenPipeFailed)
+                    result = accepted;
+            }
+            return result;
+        }
 
-    struct ClientSettings {
-        bool auto_reconnect = true;
-        uint64_t reconnect_timeout_ms = 5000;
-    };
+        /**
+         * @brief Shakes hands with the instances that are not open on a thread of its own, so a slow or
+         * silent instance does not hold up the Run thread
+         */
+        void StartRetry() {
+            retry_batch = PrepareHandshakes();
+            retry_done.store(false, std::memory_order_relaxed);
+            retry = std::jthread([this] {
+                retry_batch.Run();
+                retry_done.store(true, std::memory_order_release);
+                reactor.Wake();
+            });
+        }
 
-    class Client {
-    public:
-        Client(uint64_t client_id) : client_id(client_id) {
-            #if _WIN32
-            pipe = std::make_shared<WindowsPipe>();
-            #else
-            pipe = std::make_shared<UnixPipe>();
-            #endif
+        /**
+         * @brief Waits for the retry if it is still running and takes over the connections it opened
+         */
+        void FinishRetry() {
+            retry.join();
+            AcceptHandshakes(retry_batch);
+            retry_batch = HandshakeBatch();
         }
 
-        Result Connect() {
-            Result result;
+        Result ConnectPipes() {
+            if (connections.empty()) CreateConnections();
 
-            // Open pipe if needed
-            if (result = pipe->Open(); result != Result::Ok) return result;
+            // The pipes of a retry still running belong to it until it is done
+            if (retry.joinable()) FinishRetry();
 
-            JSON::JsonWriter writer;
-            writer.BeginObject();
-            writer.Put("v", 1);
-            writer.Put("client_id", std::to_string(client_id));
-            writer.EndObject();
+            HandshakeBatch batch = PrepareHandshakes();
+            batch.Run();
+            Result result = AcceptHandshakes(batch);
+            return OpenCount() > 0 ? Result::Ok : result;
+        }
 
-            if (result = pipe->Write(0, writer.ToString()); result != Result::Ok) return result;
-            
-            // Wait for dispatch event
-            IpcMessage message;
+        Result DisconnectPipes() {
+            if (retry.joinable()) FinishRetry();
+
+            Result result = Result::Ok;
+            for (size_t i = 0; i < connections.size(); i++) {
+                auto& connection = connections[i];
+                if (connection.IsLive() || connection.owed > 0) {
+                    ClosePipe(i, Result::PipeNotOpen);
+                    continue;
+                }
 
-            // Dispatch events do not provide a nonce; therefore, we ignore the error
-            if (result = pipe->Read(&message); result != Result::Ok) return result;
-            bool success = message.op_code == 1;
+                connection.ready = false;
+                if (Result closed = connection.pipe->Close(); closed != Result::Ok) result = closed;
+            }
+            return result;
+        }
 
-            if (success) {
-                event_callback(Event::Connected);
+        /**
+         * @brief Checks the handshake reply of a connection and starts watching it
+         */
+        Result Accept(size_t index, Result result, const IpcMessage& message) {
+            auto& connection = connections[index];
+            connection.ready = false;
+
+            std::optional<ReadyData> ready;
+            if (result == Result::Ok || result == Result::HandshakeFailed)
+                ready = message.op_code == 1 ? message.Ready() : std::nullopt;
+
+            if (!ready) {
+                connection.pipe->Close();
+                if (result != Result::Ok && result != Result::HandshakeFailed) return result;
+
+                log_callback(
+                    Result::HandshakeFailed,
+                    LogLevel::Error,
+                    std::format("Op:{} Msg:{}", message.op_code, message.message),
+                    &message
+                );
+                return Result::HandshakeFailed;
             }
 
+            connection.ready = true;
+            publish_in_flight = false; // an answer on an earlier pipe may never come
+            shown_hash.reset(); // a new connection shows nothing yet
+            connection.watched = reactor.Watch(connection.pipe->PollHandle(), static_cast<uint32_t>(index));
+            connection.watching_writes = false;
+            connection.sent_bytes = 0;
+
             log_callback(
                 Result::Ok,
                 LogLevel::Trace,
-                std::format("Op:{} Msg:{}", message.op_code, message.message),
-                message
+                std::format("Connected as {} (api {})", ready->user.username, ready->config.api_endpoint),
+                &message
             );
+            event_callback(Event::Connected);
 
-            return success ? Result::Ok : Result::HandshakeFailed;
+            ReuseLastActivity(index);
+            return Result::Ok;
         }
 
-        Result Disconnect() {
-            return pipe->Close();
-        }
+        /**
+         * @brief Sends the newest update again to a connection that just opened. The instances that stayed
+         * connected already show it, so it goes to this connection only and takes no rate limit token
+         */
+        void ReuseLastActivity(size_t index) {
+            assert(OwnsState());
 
-        Result Reconnect() {
-            if (Result result = pipe->Close(); result != Result::Ok) return result;
-            return Connect();
+            // A held back update is newer and goes out anyway
+            if (!last_activity || deferred) return;
+
+            PendingRequest request;
+            request.callback = [this](auto result, const auto& message) {
+                if (result == Result::Ok) {
+                    log_callback(result, LogLevel::Info, "Re-used last activity", &message);
+                } else {
+                    log_callback(result, LogLevel::Error, "Failed to use last activity", &message);
+                }
+            };
+            uint64_t request_id = pending.Insert(std::move(request));
+
+            IpcFrame frame { .bytes = last_activity->frame->bytes };
+            Queue(request_id, Stamp(std::move(frame), last_activity->nonce_offset, request_id), uint64_t(1) << index);
         }
 
-        void UpdateActivity(const std::shared_ptr<Activity> activity, std::function<void(Result result, IpcMessage ipc_message)> callback) {
+        /**
+         * @brief A request on its way from the submitting thread to the I/O thread. Its id, and with it the
+         * nonce, is only assigned once the I/O thread takes it
+         */
+        struct Submission {
+            IpcFrame frame;
+            size_t nonce_offset = 0;
+            ResultCallback callback;
+            std::optional<uint64_t> hash; // of the activity, if it may be skipped when already shown
+            bool reusable = true; // re-sent after reconnecting if it was the last one sent
+            std::function<void()> command {}; // runs on the Run thread instead of sending a frame
+        };
+
+        /**
+         * @brief The frame of the newest update sent, kept to be sent again after reconnecting
+         */
+        struct LastActivity {
+            std::shared_ptr<const IpcFrame> frame;
+            size_t nonce_offset = 0;
+            std::optional<uint64_t> hash;
+        };
+
+        /**
+         * @param write_activity Writes the value of "activity"
+         * @param capacity Expected size of the activity JSON
+         */
+        template<typename WriteActivity>
+        static Submission SetActivity(WriteActivity write_activity, size_t capacity, std::optional<uint64_t> hash, ResultCallback callback) {
             #if _WIN32
             int pid = GetCurrentProcessId();
             #else // unix
             int pid = getpid();
             #endif
 
-            auto nonce = UUID::GenerateUUIDv4();
-
-            JSON::JsonWriter writer;
+            IpcFrameWriter writer(1, capacity + 128);
             writer.BeginObject();
             writer.Put("cmd", "SET_ACTIVITY");
 
             writer.PendMember("args");
             writer.BeginObject();
             writer.Put("pid", pid);
-            writer.Put("activity", activity);
+            writer.PendMember("activity");
+            write_activity(writer);
             writer.EndObject();
 
-            writer.Put("nonce", nonce);
+            size_t nonce_offset = WriteNonce(writer);
             writer.EndObject();
 
-            outgoing_messages.emplace(IpcMessage {
-                .op_code = 1,
-                .message = writer.ToString(),
-                .nonce = nonce
-            });
+            return Submission {
+                .frame = IpcFrame { .bytes = writer.Finish() },
+                .nonce_offset = nonce_offset,
+                .callback = std::move(callback),
+                .hash = hash
+            };
+        }
+
+        /**
+         * @brief Writes a placeholder nonce of the final length
+         * @return Offset of the nonce text in the frame
+         */
+        static size_t WriteNonce(IpcFrameWriter& writer) {
+            writer.PendMember("nonce");
+            size_t offset = writer.View().size() + 1; // past the opening quote
+            writer.WriteString(UUID::EncodeId(0, 0).View());
+            return offset;
+        }
+
+        /**
+         * @brief Records one connection's answer to a request and runs the callback after the last one.
+         * The first failure decides the result
+         */
+        void Complete(uint64_t request_id, size_t index, Result result, const IpcMessage& message) {
+            assert(OwnsState());
+
+            // Unknown ids and second answers from the same connection are ignored
+            auto* found = pending.Find(request_id);
+            uint64_t bit = uint64_t(1) << index;
+            if (found == nullptr || (found->owed & bit) == 0) return;
+
+            found->owed &= ~bit;
+            connections[index].owed--;
+
+            if (result != Result::Ok && found->result == Result::Ok) {
+                found->result = result;
+                found->failure = message;
+            }
+
+            if (found->owed != 0) return;
 
-            callbacks[nonce] = callback;
-            last_activity = activity;
+            auto request = pending.Take(request_id);
+            if (request->result == Result::Ok && request_id == newest_request) shown_hash = newest_hash;
+            request->callback(request->result, request->result == Result::Ok ? message : request->failure);
         }
 
-        void ClearActivity(std::function<void(Result result, IpcMessage ipc_message)> callback) {
-            #if _WIN32
-            int pid = GetCurrentProcessId();
-            #else // unix
-            int pid = getpid();
-            #endif
+        /**
+         * @brief Safe from any thread, never blocks
+         */
+        void Submit(Submission submission) {
+            if (!submissions.TryPush(submission)) {
+                submission.callback(Result::QueueFull, submission.frame.ToMessage());
+                return;
+            }
+            reactor.Wake();
+        }
 
-            auto nonce = UUID::GenerateUUIDv4();
-            JSON::JsonWriter writer;
-            writer.BeginObject();
-            writer.Put("cmd", "SET_ACTIVITY");
-            writer.PendMember("args");
-            writer.BeginObject();
-            writer.Put("pid", pid);
-            writer.PendMember("activity");
+        /**
+         * @brief Runs operation on the Run thread and waits for its result. Called from the Run thread
+         * itself or while Run is not running, it runs right away
+         */
+        Result OnRunThread(std::function<Result()> operation) {
+            if (OwnsState()) return operation();
+
+            std::promise<Result> done;
+            auto result = done.get_future();
+            Submission submission;
+            submission.command = [&] { done.set_value(operation()); };
+
+            // The Run thread empties the queue on every pass, so a full one frees up shortly
+            while (!submissions.TryPush(submission)) std::this_thread::yield();
+            reactor.Wake();
+            return result.get();
+        }
 
-            // Make an empty object
-            writer.BeginObject();
-            writer.EndObject();
+        /**
+         * @brief Whether the calling thread may touch the connections, pending and last_activity: the Run
+         * thread, or any one thread while Run is not running
+         */
+        bool OwnsState() const {
+            auto run = run_thread.load(std::memory_order_acquire);
+            return run == std::thread::id() || run == std::this_thread::get_id();
+        }
 
-            // End args object
-            writer.EndObject();
+        /**
+         * @brief Runs posted commands and moves submitted frames to held, in the order they were submitted.
+         * Frames beyond the queue capacity fail with QueueFull, as they would have in a full queue
+         */
+        void TakeSubmissions() {
+            while (auto submission = submissions.TryPop()) {
+                if (submission->command) {
+                    submission->command();
+                } else if (held.size() >= settings.submit_queue_capacity) {
+                    submission->callback(Result::QueueFull, submission->frame.ToMessage());
+                } else {
+                    held.push_back(std::move(*submission));
+                }
+            }
+        }
 
-            writer.Put("nonce", nonce);
-            writer.EndObject();
+        /**
+         * @brief Hands submitted frames to every open connection, serialized once and shared, then writes
+         * as much as each pipe takes. While nothing is connected submissions wait in held
+         */
+        void FlushOutgoing() {
+            size_t open = OpenCount();
+            if (open == 0) return;
 
-            outgoing_messages.emplace(IpcMessage {
-                .op_code = 1,
-                .message = writer.ToString(),
-                .nonce = nonce
-            });
+            if (deferred && rate_limit.TryTake()) {
+                Dispatch(std::move(*deferred));
+                deferred.reset();
+            }
+
+            while (!held.empty()) {
+                Submission submission = std::move(held.front());
+                held.pop_front();
+                if (Suppress(submission)) continue;
+
+                if (!deferred && rate_limit.TryTake()) Dispatch(std::move(submission));
+                else Defer(std::move(submission));
+            }
+
+            // One published activity at a time, so whatever was published meanwhile collapses into the newest.
+            // It stays in the slot while rate limited, which keeps it just as current
+            auto now = TokenBucket::Clock::now();
+            if (publish_in_flight && now >= publish_deadline) {
+                // The answer was lost or Discord is stuck; waiting longer would hold back every later publish
+                log_callback(Result::ReadPipeNoData, LogLevel::Warn, "Published activity was not answered in time, sending the next one", nullptr);
+                publish_in_flight = false;
+            }
+
+            if (!publish_in_flight && !deferred && rate_limit.NextToken(now) <= now) {
+                Activity* newest = published.Take();
+                uint64_t hash = newest != nullptr ? newest->Hash() : 0;
+                if (newest != nullptr && hash == shown_hash) {
+                    suppressed_updates.fetch_add(1, std::memory_order_relaxed);
+                } else if (newest != nullptr) {
+                    publish_in_flight = true;
+                    publish_deadline = now + std::chrono::milliseconds(settings.publish_timeout_ms);
+                    rate_limit.TryTake(now);
+
+                    // An answer arriving after the deadline must not open the gate of a later publish
+                    uint64_t generation = ++publish_generation;
+                    auto write_activity = [&](IpcFrameWriter& writer) { writer.Write(*newest); };
+                    Dispatch(SetActivity(write_activity, 512, hash, [this, generation](Result, const IpcMessage&) {
+                        if (generation == publish_generation) publish_in_flight = false;
+                    }));
+                }
+            }
 
-            callbacks[nonce] = callback;
-            last_activity = nullptr;
+            for (size_t i = 0; i < connections.size(); i++) {
+                if (!connections[i].sending.empty()) FlushConnection(i);
+            }
         }
 
-        Result Run() {
-            Result result;
+        /**
+         * @brief Completes an update right away if Discord already shows exactly that activity. It also
+         * replaces any held back update, which would have changed it
+         */
+        bool Suppress(Submission& submission) {
+            if (!submission.hash || submission.hash != shown_hash) return false;
 
-            while (true) {
-                if (!pipe->IsOpen()) {
-                    if (settings.auto_reconnect) {
-                        log_callback(Result::PipeNotOpen, LogLevel::Error, "Pipe handle is invalid. Attempting to reconnect", std::nullopt);
-
-                        if (result = Connect(); result == Result::Ok) {
-                            log_callback(Result::Ok, LogLevel::Info, "Reconnected", std::nullopt);
-
-                            if (last_activity != nullptr) {
-                                UpdateActivity(last_activity, [this](auto result, auto message) {
-                                    if (result == Result::Ok) {
-                                        log_callback(result, LogLevel::Info, "Re-used last activity", message);
-                                    } else {
-                                        log_callback(result, LogLevel::Error, "Failed to use last activity", message);
-                                    }
-                                });
-                            }
-                        } else {
-                            log_callback(result, LogLevel::Error, "Failed to reconnect", std::nullopt);
-                        }
+            if (deferred) {
+                deferred->callback(Result::Superseded, deferred->frame.ToMessage());
+                deferred.reset();
+            }
 
-                        std::this_thread::sleep_for(std::chrono::milliseconds(settings.reconnect_timeout_ms));
-                        continue;
-                    }
+            suppressed_updates.fetch_add(1, std::memory_order_relaxed);
+            submission.callback(Result::Ok, submission.frame.ToMessage());
+            return true;
+        }
 
-                    // Wait 100ms before retrying
-                    std::this_thread::sleep_for(std::chrono::milliseconds(100));
-                    continue;
+        /**
+         * @brief Holds a rate limited submission until a token frees up, replacing the one held before
+         */
+        void Defer(Submission submission) {
+            if (deferred) deferred->callback(Result::Superseded, deferred->frame.ToMessage());
+            deferred = std::move(submission);
+        }
+
+        /**
+         * @brief Assigns the submission its request id and queues it on every open connection
+         */
+        void Dispatch(Submission submission) {
+            assert(OwnsState());
+
+            PendingRequest request;
+            request.callback = std::move(submission.callback);
+            uint64_t request_id = pending.Insert(std::move(request));
+            newest_request = request_id;
+            newest_hash = submission.hash;
+            shown_hash.reset();
+
+            uint64_t live = 0;
+            for (size_t i = 0; i < connections.size(); i++) {
+                if (connections[i].IsLive()) live |= uint64_t(1) << i;
+            }
+
+            auto shared = Stamp(std::move(submission.frame), submission.nonce_offset, request_id);
+            Queue(request_id, shared, live);
+
+            if (submission.reusable) last_activity = LastActivity { shared, submission.nonce_offset, submission.hash };
+            else last_activity.reset();
+        }
+
+        /**
+         * @brief Queues a request's frame on the connections whose bits are set in owed, which then owe it an answer
+         */
+        void Queue(uint64_t request_id, std::shared_ptr<const IpcFrame> frame, uint64_t owed) {
+            auto* request = pending.Find(request_id);
+            request->owed = owed;
+            request->frame = frame;
+
+            for (size_t i = 0; i < connections.size(); i++) {
+                if (((owed >> i) & 1) == 0) continue;
+                connections[i].sending.push_back(frame);
+                connections[i].owed++;
+            }
+        }
+
+        /**
+         * @brief Writes the request's nonce into the frame and makes it shareable between connections
+         */
+        std::shared_ptr<const IpcFrame> Stamp(IpcFrame frame, size_t nonce_offset, uint64_t request_id) {
+            auto nonce = UUID::EncodeId(nonce_prefix, request_id);
+            std::memcpy(frame.bytes.data() + nonce_offset, nonce.chars.data(), nonce.chars.size());
+            frame.request_id = request_id;
+            return std::make_shared<const IpcFrame>(std::move(frame));
+        }
+
+        /**
+         * @brief Sends a connection's frames in as few writes as the pipe allows. Frames leave the send
+         * list only once their last byte is written; the rest is resumed when the pipe is writable
+         */
+        void FlushConnection(size_t index) {
+            auto& connection = connections[index];
+
+            while (!connection.sending.empty()) {
+                std::array<std::string_view, 64> frames;
+                size_t count = std::min(connection.sending.size(), frames.size());
+                for (size_t i = 0; i < count; i++) frames[i] = connection.sending[i]->bytes;
+
+                size_t written = 0;
+                Result result = connection.pipe->WriteBatch(std::span(frames.data(), count), connection.sent_bytes, &written);
+                if (result != Result::Ok) {
+                    ClosePipe(index, result);
+                    return;
                 }
 
-                // Send queued messages
-                while (outgoing_messages.size() > 0) {
-                    auto msg = outgoing_messages.front();
-                    outgoing_messages.pop();
-                    if (result = pipe->Write(msg.op_code, msg.message); result != Result::Ok) {
-                        log_callback(result, LogLevel::Error, ResultToDescription(result), msg);
-                        
-                        if (callbacks.contains(msg.nonce)) {
-                            callbacks[msg.nonce](result, msg);
-                            callbacks.erase(msg.nonce);
-                        }
+                if (written == 0) break;
 
-                        continue;
-                    }
+                connection.sent_bytes += written;
+                auto done = connection.sending.begin();
+                while (done != connection.sending.end() && connection.sent_bytes >= (*done)->bytes.size()) {
+                    connection.sent_bytes -= (*done)->bytes.size();
+                    ++done;
                 }
+                connection.sending.erase(connection.sending.begin(), done);
+            }
+
+            bool backlog = !connection.sending.empty();
+            if (backlog != connection.watching_writes && connection.watched) {
+                auto token = static_cast<uint32_t>(index);
+                if (int space = connection.pipe->SpaceHandle(); space < 0) reactor.Watch(connection.pipe->PollHandle(), token, backlog);
+                else if (backlog) reactor.Watch(space, token);
+                else reactor.Unwatch(space);
+                connection.watching_writes = backlog;
+            }
+        }
+
+        /**
+         * @brief Closes a connection after an I/O failure. Its share of every request it still owes
+         * an answer for completes with the failure
+         */
+        void ClosePipe(size_t index, Result reason) {
+            auto& connection = connections[index];
+
+            // Handles that outlive the pipe, like a loopback's, would otherwise keep waking the loop
+            if (connection.watched) {
+                reactor.Unwatch(connection.pipe->PollHandle());
+                reactor.Unwatch(connection.pipe->SpaceHandle());
+            }
+            connection.pipe->Close();
+            connection.ready = false;
+            shown_hash.reset(); // Discord clears the activity of a closed pipe
+            connection.sent_bytes = 0;
+            connection.watching_writes = false;
+
+            connection.sending.clear();
+
+            // Collected first, since completing a request may take it from the table
+            std::vector<std::pair<uint64_t, std::shared_ptr<const IpcFrame>>> unanswered;
+            if (connection.owed > 0) {
+                pending.ForEach([&](uint64_t request_id, const PendingRequest& request) {
+                    if ((request.owed >> index) & 1) unanswered.emplace_back(request_id, request.frame);
+                });
+            }
+
+            event_callback(Event::Disconnected);
+
+            for (const auto& [request_id, frame] : unanswered) {
+                auto msg = frame->ToMessage();
+                log_callback(reason, LogLevel::Error, ResultToDescription(reason), &msg);
+                Complete(request_id, index, reason, msg);
+            }
+        }
+
+        /**
+         * @brief Reads until the pipe has nothing left so one wakeup handles back-to-back replies
+         */
+        void DrainIncoming(size_t index) {
+            auto& connection = connections[index];
 
+            while (connection.IsLive()) {
                 IpcMessage msg;
-                if (result = pipe->Read(&msg, true); result != Result::Ok) {
-                    // Timeouts are expected and necessary for the loop to continue
-                    if (result == Result::ReadPipeNoData && pipe->IsOpen()) continue;
-
-                    log_callback(result, LogLevel::Error, ResultToDescription(result), msg);
-                    if (result == Result::ReadPipeFailed) {
-                        pipe->Close(); // Close pipe handle
-                        event_callback(Event::Disconnected);
-                    }
+                Result result = connection.pipe->Read(&msg, true);
+                if (result == Result::ReadPipeNoData) return;
+
+                if (result != Result::Ok) {
+                    log_callback(result, LogLevel::Error, ResultToDescription(result), &msg);
+                    if (result == Result::ReadPipeFailed)
+                        ClosePipe(index, result);
+                    return;
+                }
+
+                if (auto error = msg.Error()) {
+                    result = msg.Cmd() == "SET_ACTIVITY" ? Result::SetActivityFailed : Result::UnknownError;
+                    log_callback(
+                        result,
+                        LogLevel::Error,
+                        std::format("Op:{} Code:{} Msg:{}", msg.op_code, error->code, error->message),
+                        &msg
+                    );
                 } else {
-                    auto success = msg.message.find("\"evt\":\"ERROR\"") == std::string::npos && msg.op_code != 2;
                     log_callback(
-                        success ? Result::Ok : Result::UnknownError,
+                        Result::Ok,
                         LogLevel::Trace,
                         std::format("Op:{} Msg:{}", msg.op_code, msg.message),
-                        msg
+                        &msg
                     );
                 }
 
-                if (callbacks.contains(msg.nonce)) {
-                    callbacks[msg.nonce](result, msg);
-                    callbacks.erase(msg.nonce);
-                }
-
-                std::this_thread::sleep_for(std::chrono::milliseconds(100));
+                if (auto request_id = UUID::DecodeId(nonce_prefix, msg.Nonce()))
+                    Complete(*request_id, index, result, msg);
             }
-
-            return Result::Ok;
-        }
-
-        void SetLogCallback(std::function<void(Result result, LogLevel level, std::string message, std::optional<IpcMessage> ipc_message)> callback) {
-            log_callback = callback;
         }
 
-        void SetEventCallback(std::function<void(Event event)> callback) {
-            event_callback = callback;
-        }
-
-        ClientSettings& GetSettings() {
-            return settings;
-        }
-    private:
         ClientSettings settings;
-        std::shared_ptr<Pipe> pipe;
         uint64_t client_id;
-        std::queue<IpcMessage> outgoing_messages;
-        std::map<std::string, std::function<void(Result result, IpcMessage ipc_message)>> callbacks;
-        std::function<void(Result result, LogLevel level, std::string message, std::optional<IpcMessage> ipc_message)> log_callback = [](auto, auto, auto, auto){};
+        Reactor reactor;
+        std::vector<Connection> connections; // created by the first Connect, one per pipe
+        MpscQueue<Submission> submissions;
+        std::deque<Submission> held; // taken from submissions, waiting for an open connection
+        std::atomic<std::thread::id> run_thread; // of the running Run, default while it is not running
+        LatestSlot<Activity> published;
+        bool publish_in_flight = false;
+        TokenBucket::Clock::time_point publish_deadline; // when an unanswered publish stops holding back the next
+        uint64_t publish_generation = 0;
+        TokenBucket rate_limit;
+        std::optional<Submission> deferred; // newest update held back by rate_limit
+        uint64_t newest_request = 0;
+        std::optional<uint64_t> newest_hash; // of the newest dispatched update
+        std::optional<uint64_t> shown_hash; // set once the newest dispatched update is acknowledged
+        std::atomic<uint64_t> suppressed_updates = 0;
+        std::atomic<uint64_t> wakeups = 0;
+        SlotTable<PendingRequest> pending; // owned by the Run thread, see OwnsState
+        uint64_t nonce_prefix = UUID::NextRandom();
+        LogCallback log_callback = [](auto, auto, auto, auto){};
         std::function<void(Event event)> event_callback = [](auto){};
-        std::shared_ptr<Activity> last_activity;
+        std::optional<LastActivity> last_activity; // owned by the Run thread, see OwnsState
+        HandshakeBatch retry_batch;
+        std::atomic<bool> retry_done = false;
+        std::jthread retry; // last, so it is joined before anything it uses is destroyed
     };
 
     inline const char* LogLevelToString(LogLevel level) {
@@ -0,0 +1,123 @@
+#include "drpc/drpc.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <format>
+#include <print>
+#include <string>
+#include <string_view>
+#include <thread>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+// Opens a UnixPipe against sockets in a temporary XDG_RUNTIME_DIR and TMPDIR, where the instance
+// Discord listens on comes after missing candidates and stale sockets that refuse connections, the
+// way a crashed client leaves them behind. Compares a new pipe, which searches every candidate in
+// order, with a pipe reopened after Close, which tries the path that worked last time first.
+
+using namespace DiscordRichPresence;
+using Clock = std::chrono::steady_clock;
+
+static int Bind(const std::string& path, bool listening) {
+    sockaddr_un addr {};
+    addr.sun_family = AF_UNIX;
+    path.copy(addr.sun_path, sizeof(addr.sun_path) - 1);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+    if (bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 || (listening && listen(fd, SOMAXCONN) != 0)) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+template<typename Open>
+static double Measure(int iterations, Open open) {
+    int failed = 0;
+    auto start = Clock::now();
+    for (int i = 0; i < iterations; i++) {
+        if (!open()) failed++;
+    }
+    auto elapsed = std::chrono::duration<double, std::micro>(Clock::now() - start).count();
+
+    if (failed > 0) std::println("{} of {} opens failed", failed, iterations);
+    return elapsed / iterations;
+}
+
+int main(int argc, char** argv) {
+    int iterations = 2000;
+    if (argc > 1) {
+        std::string_view text = argv[1];
+        if (std::from_chars(text.data(), text.data() + text.size(), iterations).ec != std::errc() || iterations <= 0) {
+            std::println("Usage: connect_bench [iterations]");
+            return 1;
+        }
+    }
+
+    char base[] = "/tmp/drpc-connect-XXXXXX";
+    if (mkdtemp(base) == nullptr) {
+        std::println(stderr, "Failed to create a temporary directory");
+        return 1;
+    }
+    std::filesystem::path runtime = std::filesystem::path(base) / "runtime";
+    std::filesystem::path temp = std::filesystem::path(base) / "tmp";
+    std::filesystem::create_directories(runtime);
+    std::filesystem::create_directories(temp);
+    setenv("XDG_RUNTIME_DIR", runtime.c_str(), 1);
+    setenv("TMPDIR", temp.c_str(), 1);
+    unsetenv("TMP");
+    unsetenv("TEMP");
+
+    // Instances 0 to 2 crashed and left their sockets; instance 3 runs from TMPDIR
+    int stale = 0;
+    for (int number = 0; number < 3; number++) {
+        if (Bind(std::format("{}/discord-ipc-{}", runtime.string(), number), false) >= 0) stale++;
+    }
+    std::string live_path = std::format("{}/discord-ipc-3", temp.string());
+    int listener = Bind(live_path, true);
+    if (listener < 0) {
+        std::println(stderr, "Failed to listen on {}", live_path);
+        return 1;
+    }
+
+    std::atomic<bool> serving = true;
+    std::thread server([&] {
+        while (serving) {
+            int fd = accept(listener, nullptr, nullptr);
+            if (fd >= 0) close(fd);
+        }
+    });
+
+    auto candidates = UnixPipe::CandidatePaths();
+    size_t position = std::ranges::find(candidates, live_path) - candidates.begin();
+
+    double cold = Measure(iterations, [] {
+        UnixPipe pipe;
+        return pipe.Open() == Result::Ok;
+    });
+
+    UnixPipe reused;
+    double cached = Measure(iterations, [&] {
+        bool opened = reused.Open() == Result::Ok;
+        reused.Close();
+        return opened;
+    });
+
+    serving = false;
+    shutdown(listener, SHUT_RDWR);
+    close(listener);
+    server.join();
+    std::filesystem::remove_all(base);
+
+    std::println("{} opens each; the live socket is candidate {} of {}, after {} stale ones", iterations, position + 1, candidates.size(), stale);
+    std::println("  new pipe, full search   {:8.1f} us", cold);
+    std::println("  reopened, cached path   {:8.1f} us", cached);
+    return 0;
+}
@@ -0,0 +1,147 @@
+#include "drpc/drpc.hpp"
+
+#include <charconv>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <print>
+#include <string_view>
+#include <tuple>
+#include <vector>
+
+// Serializes the example Activity and each of its parts with JSON::Serialize, which walks the
+// JsonFields() tables and copies pre-rendered "key": fragments. For comparison the same tables are
+// walked with every key written at runtime through PendMember. Both must produce the payload the
+// activity types produced before they had field tables, byte for byte.
+
+using namespace DiscordRichPresence;
+using Clock = std::chrono::steady_clock;
+
+// Serialized with the virtual ToJson members these types used to have
+static constexpr std::string_view expected_payload =
+    R"({"name":"drpc","client_id":1355907951155740785,"type":0,"details":"Line 1","state":"Party",)"
+    R"("timestamps":{"start":1700000000},"party":{"id":"test","size":[2,5]},"assets":{"large_image":"my_image",)"
+    R"("large_text":"You hovered over the large image","small_image":"my_image","small_text":"I didn't have another image"},)"
+    R"("buttons":[{"label":"Test","url":"https://yooksch.com"},{"label":"Test 2","url":"https://youtu.be/dQw4w9WgXcQ"}]})";
+
+static Activity MakeActivity() {
+    Activity activity;
+    activity.SetClientId(1355907951155740785);
+    activity.SetName("drpc");
+    activity.SetDetails("Line 1");
+    activity.GetTimestamps()->SetStart(1700000000);
+
+    auto assets = activity.GetAssets();
+    assets->SetLargeImage("my_image");
+    assets->SetLargeImageText("You hovered over the large image");
+    assets->SetSmallImage("my_image");
+    assets->SetSmallImageText("I didn't have another image");
+
+    auto party = std::make_shared<Party>();
+    party->SetId("test");
+    party->SetCurrentSize(2);
+    party->SetMaxSize(5);
+    activity.SetParty(party);
+    activity.SetState("Party");
+
+    activity.AddButton(std::make_shared<Button>("Test", "https://yooksch.com"));
+    activity.AddButton(std::make_shared<Button>("Test 2", "https://youtu.be/dQw4w9WgXcQ"));
+    return activity;
+}
+
+template<JSON::Described T>
+static void WriteWithRuntimeKeys(JSON::JsonWriter& writer, const T& object);
+
+template<typename T>
+static void WriteValue(JSON::JsonWriter& writer, const T& value) {
+    writer.Write(value);
+}
+
+template<JSON::Described T>
+static void WriteValue(JSON::JsonWriter& writer, const std::shared_ptr<T>& value) {
+    WriteWithRuntimeKeys(writer, *value);
+}
+
+template<JSON::Described T>
+static void WriteValue(JSON::JsonWriter& writer, const std::vector<std::shared_ptr<T>>& values) {
+    writer.BeginArray();
+    for (size_t i = 0; i < values.size(); i++) {
+        if (i > 0) writer.WriteRaw(",");
+        WriteWithRuntimeKeys(writer, *values[i]);
+    }
+    writer.EndArray();
+}
+
+template<JSON::Described T>
+static void WriteWithRuntimeKeys(JSON::JsonWriter& writer, const T& object) {
+    writer.BeginObject();
+    std::apply([&](const auto&... fields) {
+        auto write_field = [&](const auto& field) {
+            const auto& value = object.*field.member;
+            if (field.skip != nullptr && field.skip(value)) return;
+
+            // "key": back to key
+            writer.PendMember(field.key.substr(1, field.key.size() - 3));
+            WriteValue(writer, value);
+        };
+        (write_field(fields), ...);
+    }, T::JsonFields());
+    writer.EndObject();
+}
+
+template<typename Render>
+static double Measure(int iterations, Render render) {
+    JSON::JsonWriter writer(1024);
+    size_t bytes = 0;
+
+    auto start = Clock::now();
+    for (int i = 0; i < iterations; i++) {
+        writer.Reset();
+        render(writer);
+        bytes += writer.View().size();
+    }
+    auto elapsed = std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+
+    // Keeps the work from being optimized away
+    if (bytes == 0) std::println("nothing rendered");
+    return elapsed / iterations;
+}
+
+template<JSON::Described T>
+static void Report(int iterations, std::string_view name, const T& object) {
+    double tables = Measure(iterations, [&](JSON::JsonWriter& writer) { JSON::Serialize(&writer, object); });
+    double runtime = Measure(iterations, [&](JSON::JsonWriter& writer) { WriteWithRuntimeKeys(writer, object); });
+    std::println("  {:<10} {:10.1f} {:14.1f}", name, tables, runtime);
+}
+
+int main(int argc, char** argv) {
+    int iterations = 1000000;
+    if (argc > 1) {
+        std::string_view text = argv[1];
+        if (std::from_chars(text.data(), text.data() + text.size(), iterations).ec != std::errc() || iterations <= 0) {
+            std::println("Usage: descriptor_bench [iterations]");
+            return 1;
+        }
+    }
+
+    Activity activity = MakeActivity();
+
+    JSON::JsonWriter tables;
+    JSON::Serialize(&tables, activity);
+    JSON::JsonWriter runtime;
+    WriteWithRuntimeKeys(runtime, activity);
+    if (tables.View() != expected_payload || runtime.View() != expected_payload) {
+        std::println("Payload changed:\n  expected      {}\n  JSON::Serialize {}\n  runtime keys    {}",
+            expected_payload, tables.View(), runtime.View());
+        return 1;
+    }
+
+    std::println("{} serializations each, ns; payload is byte-identical", iterations);
+    std::println("  {:<10} {:>10} {:>14}", "type", "tables", "runtime keys");
+    Report(iterations, "Timestamps", *activity.GetTimestamps());
+    Report(iterations, "Party", *activity.GetParty());
+    Report(iterations, "Assets", *activity.GetAssets());
+    Report(iterations, "Button", Button("Test", "https://yooksch.com"));
+    Report(iterations, "Activity", activity);
+    return 0;
+}
@@ -0,0 +1,121 @@
+#include "drpc/drpc.hpp"
+
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <print>
+#include <random>
+#include <string>
+#include <string_view>
+
+// Escapes clean and escape-heavy strings of several lengths with JsonWriter::WriteString, and with
+// a byte-at-a-time escaper for comparison. Checks that both give the same output and reports MB/s
+// of input.
+
+using namespace DiscordRichPresence;
+using Clock = std::chrono::steady_clock;
+
+static void EscapeBytewise(std::string& out, std::string_view str) {
+    static constexpr char hex_digits[] = "0123456789abcdef";
+
+    out.push_back('"');
+    for (char ch : str) {
+        unsigned char c = static_cast<unsigned char>(ch);
+        switch (c) {
+        case '"': out += "\\\""; break;
+        case '\\': out += "\\\\"; break;
+        case '\b': out += "\\b"; break;
+        case '\f': out += "\\f"; break;
+        case '\n': out += "\\n"; break;
+        case '\r': out += "\\r"; break;
+        case '\t': out += "\\t"; break;
+        default:
+            if (c < 0x20) {
+                out += "\\u00";
+                out.push_back(hex_digits[c >> 4]);
+                out.push_back(hex_digits[c & 0xF]);
+            } else {
+                out.push_back(ch);
+            }
+        }
+    }
+    out.push_back('"');
+}
+
+// Printable text, with one in every escape_every bytes replaced by a quote, backslash or control character
+static std::string MakeInput(size_t length, size_t escape_every) {
+    static constexpr char specials[] = { '"', '\\', '\n', '\t', '\x01', '\x1f' };
+    std::mt19937 rng(static_cast<uint32_t>(length * 31 + escape_every));
+    std::uniform_int_distribution<int> printable(' ' + 1, '~');
+
+    std::string input;
+    for (size_t i = 0; i < length; i++) {
+        char c = static_cast<char>(printable(rng));
+        if (c == '"' || c == '\\') c = 'x';
+        if (escape_every > 0 && i % escape_every == escape_every - 1) c = specials[rng() % sizeof(specials)];
+        input.push_back(c);
+    }
+    return input;
+}
+
+template<typename Escape>
+static double Measure(int iterations, std::string_view input, Escape escape) {
+    size_t bytes = 0;
+
+    auto start = Clock::now();
+    for (int i = 0; i < iterations; i++) bytes += escape(input);
+    auto elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+
+    // Keeps the work from being optimized away
+    if (bytes == 0) std::println("nothing escaped");
+    return static_cast<double>(input.size()) * iterations / elapsed / 1e6;
+}
+
+int main(int argc, char** argv) {
+    int iterations = 200000;
+    if (argc > 1) {
+        std::string_view text = argv[1];
+        if (std::from_chars(text.data(), text.data() + text.size(), iterations).ec != std::errc() || iterations <= 0) {
+            std::println("Usage: escape_bench [iterations]");
+            return 1;
+        }
+    }
+
+    JSON::JsonWriter writer(16384);
+    std::string reference;
+    reference.reserve(16384);
+
+    auto write_string = [&](std::string_view input) {
+        writer.Reset();
+        writer.WriteString(input);
+        return writer.View().size();
+    };
+    auto bytewise = [&](std::string_view input) {
+        reference.clear();
+        EscapeBytewise(reference, input);
+        return reference.size();
+    };
+
+    std::println("{} iterations, MB/s of input", iterations);
+    std::println("  {:>6} {:>14} {:>12} {:>12}", "length", "escapes", "WriteString", "bytewise");
+    for (size_t length : { 16, 128, 4096 }) {
+        for (size_t escape_every : { 0, 4 }) {
+            std::string input = MakeInput(length, escape_every);
+            write_string(input);
+            bytewise(input);
+            if (writer.View() != reference) {
+                std::println("Output differs from the bytewise escaper for {}", input);
+                return 1;
+            }
+
+            // Keeps the total work roughly the same for every length
+            int scaled = std::max(1, static_cast<int>(iterations * 128 / length / 4));
+            double fast = Measure(scaled, input, write_string);
+            double slow = Measure(scaled, input, bytewise);
+            std::println("  {:>6} {:>14} {:12.0f} {:12.0f}", length, escape_every ? "1 in 4 bytes" : "none", fast, slow);
+        }
+    }
+    return 0;
+}
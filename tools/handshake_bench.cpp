@@ -0,0 +1,200 @@
+#include "drpc/drpc.hpp"
+
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <format>
+#include <print>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include <csignal>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+// Starts several Discord stand-ins on the candidate paths of a temporary XDG_RUNTIME_DIR and
+// TMPDIR, each answering the handshake after its own delay or not at all, and lets UnixPipe race
+// them. The first READY has to win no matter where its path is in the search order; when every
+// instance is silent the handshake has to fail once its timeout runs out.
+
+using namespace DiscordRichPresence;
+using Clock = std::chrono::steady_clock;
+
+struct Instance {
+    std::string subdirectory; // of the scenario's runtime or temp directory
+    bool in_runtime_dir;
+    int delay_ms; // before READY, or -1 to never answer
+    std::string username;
+};
+
+struct Scenario {
+    std::string_view name;
+    std::vector<Instance> instances;
+    std::string_view winner; // username expected to win, empty if the handshake has to fail
+};
+
+static constexpr auto handshake_timeout = std::chrono::milliseconds(500);
+
+static std::string ReadyFrame(std::string_view username) {
+    IpcFrameWriter writer(1, 256);
+    writer.BeginObject();
+    writer.Put("cmd", "DISPATCH");
+    writer.PendMember("data");
+    writer.BeginObject();
+    writer.Put("v", 1);
+    writer.PendMember("config");
+    writer.WriteRaw(R"({"cdn_host":"cdn.discordapp.com","api_endpoint":"//discord.com/api","environment":"production"})");
+    writer.PendMember("user");
+    writer.BeginObject();
+    writer.Put("id", "1");
+    writer.Put("username", username);
+    writer.Put("discriminator", "0");
+    writer.Put("global_name", "Mock");
+    writer.Put("avatar", nullptr);
+    writer.EndObject();
+    writer.EndObject();
+    writer.Put("evt", "READY");
+    writer.Put("nonce", nullptr);
+    writer.EndObject();
+    return writer.Finish();
+}
+
+// Answers one connection's handshake and holds it open until the client closes it
+static void Answer(int fd, Instance instance) {
+    IpcFrameReader reader;
+    IpcMessage message;
+    bool answered = false;
+
+    while (true) {
+        auto space = reader.Writable();
+        ssize_t received = recv(fd, space.data(), space.size(), 0);
+        if (received <= 0) break;
+        reader.Commit(received);
+
+        if (answered || instance.delay_ms < 0 || reader.Next(&message) != Result::Ok) continue;
+
+        std::this_thread::sleep_for(std::chrono::milliseconds(instance.delay_ms));
+        std::string frame = ReadyFrame(instance.username);
+        if (send(fd, frame.data(), frame.size(), 0) != static_cast<ssize_t>(frame.size())) break;
+        answered = true;
+    }
+    close(fd);
+}
+
+static bool Listen(const std::string& path, Instance instance) {
+    sockaddr_un addr {};
+    addr.sun_family = AF_UNIX;
+    path.copy(addr.sun_path, sizeof(addr.sun_path) - 1);
+
+    int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listener < 0 || bind(listener, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 || listen(listener, 64) != 0)
+        return false;
+
+    // Runs until the process exits
+    std::thread([listener, instance] {
+        while (true) {
+            if (int fd = accept(listener, nullptr, nullptr); fd >= 0)
+                std::thread(Answer, fd, instance).detach();
+        }
+    }).detach();
+    return true;
+}
+
+static std::string HandshakeFrame() {
+    IpcFrameWriter writer(0, 64);
+    writer.BeginObject();
+    writer.Put("v", 1);
+    writer.Put("client_id", "123");
+    writer.EndObject();
+    return writer.Finish();
+}
+
+static bool RunScenario(int iterations, const std::filesystem::path& base, const Scenario& scenario) {
+    std::filesystem::path runtime = base / "runtime";
+    std::filesystem::path temp = base / "tmp";
+    setenv("XDG_RUNTIME_DIR", runtime.c_str(), 1);
+    setenv("TMPDIR", temp.c_str(), 1);
+
+    auto candidates = UnixPipe::CandidatePaths();
+    std::vector<std::string> positions;
+    for (const auto& instance : scenario.instances) {
+        auto directory = (instance.in_runtime_dir ? runtime : temp) / instance.subdirectory;
+        std::filesystem::create_directories(directory);
+        std::string path = (directory / "discord-ipc-0").string();
+        if (!Listen(path, instance)) {
+            std::println(stderr, "Failed to listen on {}", path);
+            return false;
+        }
+
+        size_t position = std::ranges::find(candidates, path) - candidates.begin() + 1;
+        std::string delay = instance.delay_ms < 0 ? "silent" : std::format("{} ms", instance.delay_ms);
+        positions.push_back(std::format("#{} {}", position, delay));
+    }
+
+    std::string handshake = HandshakeFrame();
+    std::vector<double> elapsed_ms;
+    int correct = 0;
+    for (int i = 0; i < iterations; i++) {
+        UnixPipe pipe;
+        pipe.SetHandshakeTimeout(handshake_timeout);
+
+        IpcMessage reply;
+        auto start = Clock::now();
+        Result result = pipe.Handshake(handshake, &reply);
+        elapsed_ms.push_back(std::chrono::duration<double, std::milli>(Clock::now() - start).count());
+
+        auto ready = result == Result::Ok ? reply.Ready() : std::nullopt;
+        if (scenario.winner.empty() ? result == Result::HandshakeFailed : ready && ready->user.username == scenario.winner)
+            correct++;
+    }
+
+    std::ranges::sort(elapsed_ms);
+    std::string instances;
+    for (const auto& position : positions) instances += (instances.empty() ? "" : ", ") + position;
+    std::println("  {:<28} {:>7}/{:<3} {:8.1f} {:8.1f}   {}", scenario.name, correct, iterations,
+        elapsed_ms[elapsed_ms.size() / 2], elapsed_ms.back(), instances);
+    return correct == iterations;
+}
+
+int main(int argc, char** argv) {
+    int iterations = 10;
+    if (argc > 1) {
+        std::string_view text = argv[1];
+        if (std::from_chars(text.data(), text.data() + text.size(), iterations).ec != std::errc() || iterations <= 0) {
+            std::println("Usage: handshake_bench [iterations]");
+            return 1;
+        }
+    }
+
+    std::signal(SIGPIPE, SIG_IGN);
+    unsetenv("TMP");
+    unsetenv("TEMP");
+
+    char base[] = "/tmp/drpc-handshake-XXXXXX";
+    if (mkdtemp(base) == nullptr) {
+        std::println(stderr, "Failed to create a temporary directory");
+        return 1;
+    }
+
+    const std::string flatpak = "app/com.discordapp.Discord";
+    const std::vector<Scenario> scenarios {
+        { "fastest searched first", { { "", true, 0, "fast" }, { "", false, 200, "slow" } }, "fast" },
+        { "fastest searched last", { { "", true, 300, "slow" }, { flatpak, true, 150, "flatpak" }, { "", false, 0, "fast" } }, "fast" },
+        { "first silent, then slow", { { "", true, -1, "silent" }, { "", false, 100, "slow" } }, "slow" },
+        { "all silent", { { "", true, -1, "silent" }, { flatpak, true, -1, "silent" }, { "", false, -1, "silent" } }, "" },
+    };
+
+    std::println("{} handshakes per scenario, timeout {} ms; #N is the instance's place in the search order", iterations, handshake_timeout.count());
+    std::println("  {:<28} {:>11} {:>8} {:>8}   {}", "scenario", "correct", "p50 ms", "max ms", "instances");
+    bool passed = true;
+    for (size_t i = 0; i < scenarios.size(); i++)
+        passed &= RunScenario(iterations, std::filesystem::path(base) / std::to_string(i), scenarios[i]);
+
+    std::filesystem::remove_all(base);
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,93 @@
+#include "drpc/drpc.hpp"
+
+#include <charconv>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <print>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// Reports sizeof(JsonValue) and the cost of nested JsonValue payloads like the party's size array
+// and the button list: building them from std::map and from ordered members, and serializing one
+// that is already built.
+
+using namespace DiscordRichPresence;
+using Clock = std::chrono::steady_clock;
+
+static JSON::JsonValue MakeFromMaps() {
+    using Map = std::map<std::string, JSON::JsonValue>;
+    return Map {
+        { "party", Map { { "id", "lobby-1234" }, { "size", std::vector<JSON::JsonValue> { 3, 4 } } } },
+        { "buttons", std::vector<JSON::JsonValue> {
+            Map { { "label", "Join" }, { "url", "https://example.com/join/1234" } },
+            Map { { "label", "Watch" }, { "url", "https://example.com/watch/1234" } }
+        } }
+    };
+}
+
+static JSON::JsonValue MakeFromMembers() {
+    using Members = std::vector<std::pair<std::string, JSON::JsonValue>>;
+    return Members {
+        { "party", Members { { "id", "lobby-1234" }, { "size", std::vector<JSON::JsonValue> { 3, 4 } } } },
+        { "buttons", std::vector<JSON::JsonValue> {
+            Members { { "label", "Join" }, { "url", "https://example.com/join/1234" } },
+            Members { { "label", "Watch" }, { "url", "https://example.com/watch/1234" } }
+        } }
+    };
+}
+
+template<typename Render>
+static double Measure(int iterations, Render render) {
+    JSON::JsonWriter writer(512);
+    size_t bytes = 0;
+
+    auto start = Clock::now();
+    for (int i = 0; i < iterations; i++) {
+        writer.Reset();
+        render(writer);
+        bytes += writer.View().size();
+    }
+    auto elapsed = std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+
+    // Keeps the work from being optimized away
+    if (bytes == 0) std::println("nothing rendered");
+    return elapsed / iterations;
+}
+
+int main(int argc, char** argv) {
+    int iterations = 500000;
+    if (argc > 1) {
+        std::string_view text = argv[1];
+        if (std::from_chars(text.data(), text.data() + text.size(), iterations).ec != std::errc() || iterations <= 0) {
+            std::println("Usage: jsonvalue_bench [iterations]");
+            return 1;
+        }
+    }
+
+    double from_maps = Measure(iterations, [](JSON::JsonWriter& writer) {
+        MakeFromMaps().ToJson(&writer);
+    });
+
+    double from_members = Measure(iterations, [](JSON::JsonWriter& writer) {
+        MakeFromMembers().ToJson(&writer);
+    });
+
+    const JSON::JsonValue built = MakeFromMembers();
+    double serialize_only = Measure(iterations, [&](JSON::JsonWriter& writer) {
+        built.ToJson(&writer);
+    });
+
+    JSON::JsonWriter writer;
+    built.ToJson(&writer);
+    double megabytes = static_cast<double>(writer.View().size()) / 1e6;
+
+    std::println("sizeof(JsonValue) = {} bytes", sizeof(JSON::JsonValue));
+    std::println("{} payloads of a party with its size array and two buttons ({} bytes)", iterations, writer.View().size());
+    std::println("  built from std::map, serialized  {:8.1f} ns", from_maps);
+    std::println("  built from members, serialized   {:8.1f} ns", from_members);
+    std::println("  serialized only                  {:8.1f} ns {:8.1f} MB/s", serialize_only, megabytes / (serialize_only * 1e-9));
+    return 0;
+}
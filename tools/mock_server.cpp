@@ -0,0 +1,378 @@
+#include "drpc/drpc.hpp"
+
+#include <charconv>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <print>
+#include <random>
+#include <set>
+#include <string>
+#include <string_view>
+
+#include <csignal>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+// A stand-in for the Discord client. It listens on a Unix socket, answers the handshake with READY
+// and echoes SET_ACTIVITY nonces, with optional latency and faults for benchmarks and stress tests.
+// Several of them on different candidate paths, with different handshake delays or --silent, play
+// instances racing for the handshake.
+
+using namespace DiscordRichPresence;
+using Clock = std::chrono::steady_clock;
+
+struct Options {
+    std::string path;
+    std::string username = "mock";
+    int handshake_delay_ms = 0;
+    bool silent = false;
+    int latency_ms = 0;
+    int jitter_ms = 0;
+    int coalesce_ms = 0;
+    double drop = 0;
+    double error = 0;
+    double split = 0;
+    double disconnect = 0;
+    uint64_t seed = 1;
+    bool verbose = false;
+};
+
+struct Peer {
+    IpcFrameReader reader;
+    Clock::time_point last_due; // replies never overtake each other
+    std::string outbox; // due bytes the socket did not take yet, sent once it is writable
+};
+
+struct Chunk {
+    int fd;
+    std::string bytes;
+};
+
+static void PrintUsage() {
+    std::println("Usage: mock_server [options]");
+    std::println("  --path PATH         socket to listen on (default $XDG_RUNTIME_DIR/discord-ipc-0)");
+    std::println("  --username NAME     user in the READY event, to tell instances apart (default mock)");
+    std::println("  --handshake-delay MS extra delay before READY");
+    std::println("  --silent            never answer the handshake");
+    std::println("  --latency MS        delay before every reply");
+    std::println("  --jitter MS         random extra delay of up to MS");
+    std::println("  --coalesce MS       hold replies to the next MS boundary so they share one write");
+    std::println("  --drop P            probability of never answering a command");
+    std::println("  --error P           probability of answering with an ERROR event");
+    std::println("  --split P           probability of sending a reply in two writes");
+    std::println("  --disconnect P      probability of closing the connection on a frame");
+    std::println("  --seed N            seed for the fault rolls");
+    std::println("  --verbose           log every frame");
+}
+
+template<typename T>
+static bool ParseValue(std::string_view text, T* value) {
+    auto [end, ec] = std::from_chars(text.data(), text.data() + text.size(), *value);
+    return ec == std::errc() && end == text.data() + text.size();
+}
+
+static bool ParseOptions(int argc, char** argv, Options* options) {
+    for (int i = 1; i < argc; i++) {
+        std::string_view flag = argv[i];
+        if (flag == "--verbose") {
+            options->verbose = true;
+            continue;
+        }
+        if (flag == "--silent") {
+            options->silent = true;
+            continue;
+        }
+
+        if (i + 1 >= argc) return false;
+        std::string_view value = argv[++i];
+
+        bool ok = true;
+        if (flag == "--path") options->path = value;
+        else if (flag == "--username") options->username = value;
+        else if (flag == "--handshake-delay") ok = ParseValue(value, &options->handshake_delay_ms);
+        else if (flag == "--latency") ok = ParseValue(value, &options->latency_ms);
+        else if (flag == "--jitter") ok = ParseValue(value, &options->jitter_ms);
+        else if (flag == "--coalesce") ok = ParseValue(value, &options->coalesce_ms);
+        else if (flag == "--drop") ok = ParseValue(value, &options->drop);
+        else if (flag == "--error") ok = ParseValue(value, &options->error);
+        else if (flag == "--split") ok = ParseValue(value, &options->split);
+        else if (flag == "--disconnect") ok = ParseValue(value, &options->disconnect);
+        else if (flag == "--seed") ok = ParseValue(value, &options->seed);
+        else return false;
+
+        if (!ok) return false;
+    }
+
+    if (options->path.empty()) {
+        const char* runtime_dir = getenv("XDG_RUNTIME_DIR");
+        options->path = std::string(runtime_dir && *runtime_dir ? runtime_dir : "/tmp") + "/discord-ipc-0";
+    }
+    return true;
+}
+
+/**
+ * @brief The raw JSON of a member of object, or an empty view
+ */
+static std::string_view Member(std::string_view object, std::string_view key) {
+    JSON::JsonReader reader(object);
+    if (reader.Next().type != JSON::TokenType::BeginObject) return {};
+
+    while (true) {
+        JSON::Token name = reader.Next();
+        if (name.type != JSON::TokenType::String) return {};
+
+        JSON::Token value = reader.Next();
+        std::string_view raw = reader.SkipValue(value);
+        if (raw.empty()) return {};
+        if (name.text == key) return raw;
+    }
+}
+
+static std::string ReadyFrame(std::string_view username) {
+    IpcFrameWriter writer(1, 256);
+    writer.BeginObject();
+    writer.Put("cmd", "DISPATCH");
+    writer.PendMember("data");
+    writer.BeginObject();
+    writer.Put("v", 1);
+    writer.PendMember("config");
+    writer.WriteRaw(R"({"cdn_host":"cdn.discordapp.com","api_endpoint":"//discord.com/api","environment":"production"})");
+    writer.PendMember("user");
+    writer.BeginObject();
+    writer.Put("id", "1");
+    writer.Put("username", username);
+    writer.Put("discriminator", "0");
+    writer.Put("global_name", "Mock");
+    writer.Put("avatar", nullptr);
+    writer.EndObject();
+    writer.EndObject();
+    writer.Put("evt", "READY");
+    writer.Put("nonce", nullptr);
+    writer.EndObject();
+    return writer.Finish();
+}
+
+static std::string ReplyFrame(const IpcMessage& message, bool error) {
+    IpcFrameWriter writer(1, message.message.size() + 64);
+    writer.BeginObject();
+    writer.Put("cmd", message.Cmd());
+    writer.PendMember("data");
+    if (error) {
+        writer.WriteRaw(R"({"code":4000,"message":"Injected error"})");
+        writer.Put("evt", "ERROR");
+    } else {
+        std::string_view activity = Member(Member(message.message, "args"), "activity");
+        writer.WriteRaw(activity.empty() ? "null" : activity);
+        writer.Put("evt", nullptr);
+    }
+    writer.Put("nonce", message.Nonce());
+    writer.EndObject();
+    return writer.Finish();
+}
+
+int main(int argc, char** argv) {
+    Options options;
+    if (!ParseOptions(argc, argv, &options)) {
+        PrintUsage();
+        return 1;
+    }
+
+    // Clients that vanish must not take the server down with them
+    std::signal(SIGPIPE, SIG_IGN);
+
+    sockaddr_un addr {};
+    if (options.path.size() >= sizeof(addr.sun_path)) {
+        std::println(stderr, "Socket path is too long: {}", options.path);
+        return 1;
+    }
+    addr.sun_family = AF_UNIX;
+    options.path.copy(addr.sun_path, options.path.size());
+
+    unlink(options.path.c_str());
+    int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listener < 0 || bind(listener, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 || listen(listener, 16) != 0) {
+        std::println(stderr, "Failed to listen on {}", options.path);
+        return 1;
+    }
+    std::println("Listening on {}", options.path);
+
+    std::mt19937_64 random(options.seed);
+    std::uniform_real_distribution<double> roll(0.0, 1.0);
+    auto happens = [&](double probability) { return probability > 0 && roll(random) < probability; };
+
+    std::map<int, Peer> peers;
+    std::multimap<Clock::time_point, Chunk> scheduled; // equal deadlines keep insertion order
+
+    auto log = [&](int fd, std::string_view what) {
+        if (options.verbose) std::println("[{}] {}", fd, what);
+    };
+
+    auto drop_peer = [&](int fd) {
+        close(fd);
+        peers.erase(fd);
+        std::erase_if(scheduled, [fd](const auto& entry) { return entry.second.fd == fd; });
+    };
+
+    // Sends as much of the outbox as the socket takes without blocking, so a client that does not
+    // read only holds up itself. Returns false once the connection is gone
+    auto flush = [&](int fd, Peer& peer) {
+        size_t sent_total = 0;
+        while (sent_total < peer.outbox.size()) {
+            ssize_t sent = send(fd, peer.outbox.data() + sent_total, peer.outbox.size() - sent_total, MSG_DONTWAIT);
+            if (sent < 0 && errno == EINTR) continue;
+            if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+            if (sent < 0) {
+                log(fd, "write failed");
+                drop_peer(fd);
+                return false;
+            }
+            sent_total += sent;
+        }
+
+        peer.outbox.erase(0, sent_total);
+        if (!peer.outbox.empty()) log(fd, std::format("{} bytes waiting for the client to read", peer.outbox.size()));
+        return true;
+    };
+
+    auto schedule = [&](int fd, std::string frame, int delay_ms = 0) {
+        Peer& peer = peers[fd];
+        auto due = Clock::now() + std::chrono::milliseconds(options.latency_ms + delay_ms);
+        if (options.jitter_ms > 0)
+            due += std::chrono::milliseconds(std::uniform_int_distribution<int>(0, options.jitter_ms)(random));
+
+        if (options.coalesce_ms > 0) {
+            auto window = std::chrono::milliseconds(options.coalesce_ms);
+            auto since_epoch = due.time_since_epoch();
+            due = Clock::time_point((since_epoch + window - Clock::duration(1)) / window * window);
+        }
+        due = std::max(due, peer.last_due);
+
+        if (frame.size() > 1 && happens(options.split)) {
+            size_t cut = std::uniform_int_distribution<size_t>(1, frame.size() - 1)(random);
+            scheduled.emplace(due, Chunk { fd, frame.substr(0, cut) });
+            frame.erase(0, cut);
+            due += std::chrono::milliseconds(1);
+            log(fd, std::format("split reply at byte {}", cut));
+        }
+
+        scheduled.emplace(due, Chunk { fd, std::move(frame) });
+        peer.last_due = due;
+    };
+
+    // Returns false once the connection is gone
+    auto handle = [&](int fd, const IpcMessage& message) {
+        log(fd, std::format("op {} {}", message.op_code, message.message));
+
+        if (happens(options.disconnect)) {
+            log(fd, "disconnecting");
+            drop_peer(fd);
+            return false;
+        }
+
+        switch (message.op_code) {
+        case 0: // handshake
+            if (options.silent) {
+                log(fd, "not answering the handshake");
+                break;
+            }
+            schedule(fd, ReadyFrame(options.username), options.handshake_delay_ms);
+            break;
+        case 1: // frame
+            if (happens(options.drop)) {
+                log(fd, "dropping reply");
+                break;
+            }
+            schedule(fd, ReplyFrame(message, happens(options.error)));
+            break;
+        case 2: // close
+            drop_peer(fd);
+            return false;
+        case 3: { // ping
+            IpcFrameWriter writer(4, message.message.size());
+            writer.WriteRaw(message.message);
+            schedule(fd, writer.Finish());
+            break;
+        }
+        }
+        return true;
+    };
+
+    std::vector<pollfd> poll_fds;
+    while (true) {
+        poll_fds.clear();
+        poll_fds.push_back(pollfd { .fd = listener, .events = POLLIN, .revents = 0 });
+        for (const auto& [fd, peer] : peers) {
+            short events = peer.outbox.empty() ? POLLIN : POLLIN | POLLOUT;
+            poll_fds.push_back(pollfd { .fd = fd, .events = events, .revents = 0 });
+        }
+
+        int timeout_ms = -1;
+        if (!scheduled.empty()) {
+            auto wait = std::chrono::ceil<std::chrono::milliseconds>(scheduled.begin()->first - Clock::now());
+            timeout_ms = static_cast<int>(std::max<int64_t>(wait.count(), 0));
+        }
+
+        if (poll(poll_fds.data(), poll_fds.size(), timeout_ms) < 0 && errno != EINTR) {
+            std::println(stderr, "poll failed");
+            return 1;
+        }
+
+        for (const auto& poll_fd : poll_fds) {
+            if (poll_fd.revents == 0) continue;
+
+            if (poll_fd.fd == listener) {
+                if (int fd = accept(listener, nullptr, nullptr); fd >= 0) {
+                    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+                    peers[fd];
+                    log(fd, "connected");
+                }
+                continue;
+            }
+
+            int fd = poll_fd.fd;
+            auto peer = peers.find(fd);
+            if (peer == peers.end()) continue;
+
+            if ((poll_fd.revents & POLLOUT) && !flush(fd, peer->second)) continue;
+            if ((poll_fd.revents & (POLLIN | POLLHUP | POLLERR)) == 0) continue;
+
+            auto space = peer->second.reader.Writable();
+            ssize_t received = recv(fd, space.data(), space.size(), MSG_DONTWAIT);
+            if (received <= 0) {
+                if (received < 0 && (errno == EAGAIN || errno == EINTR)) continue;
+                log(fd, "closed by client");
+                drop_peer(fd);
+                continue;
+            }
+            peer->second.reader.Commit(received);
+
+            IpcMessage message;
+            Result result;
+            while ((result = peer->second.reader.Next(&message)) == Result::Ok) {
+                if (!handle(fd, message)) break;
+            }
+            if (result == Result::ReadPipeFailed) {
+                log(fd, "bad frame");
+                drop_peer(fd);
+            }
+        }
+
+        // Everything due for one client goes out in a single write
+        std::set<int> due;
+        auto now = Clock::now();
+        while (!scheduled.empty() && scheduled.begin()->first <= now) {
+            auto chunk = std::move(scheduled.begin()->second);
+            scheduled.erase(scheduled.begin());
+            peers[chunk.fd].outbox += chunk.bytes;
+            due.insert(chunk.fd);
+        }
+
+        for (int fd : due) {
+            if (auto peer = peers.find(fd); peer != peers.end()) flush(fd, peer->second);
+        }
+    }
+}
@@ -0,0 +1,92 @@
+#include "drpc/drpc.hpp"
+
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <cstdint>
+#include <format>
+#include <print>
+#include <random>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+// Generates nonces with UUID::GenerateUUIDv4 and UUID::EncodeId, on one thread and on several at
+// once, next to the function-static std::mt19937 generator they replaced, which drew one
+// distribution sample per hex digit. That generator is not thread-safe, so it only runs on one thread.
+
+using namespace DiscordRichPresence;
+using Clock = std::chrono::steady_clock;
+
+static std::string GenerateWithMersenneTwister() {
+    static std::random_device rd;
+    static std::mt19937 mt(rd());
+    static std::uniform_int_distribution<int> distribution(0, 15);
+    const auto get_digit = [] {
+        int value = distribution(mt);
+        return static_cast<char>(value < 10 ? '0' + value : 'a' + (value - 10));
+    };
+
+    std::string result;
+    for (int i = 0; i < 8; i++) result += get_digit();
+    result += '-';
+    for (int i = 0; i < 4; i++) result += get_digit();
+    result += "-4";
+    for (int i = 0; i < 3; i++) result += get_digit();
+    result += '-';
+    for (int i = 0; i < 4; i++) result += get_digit();
+    result += '-';
+    for (int i = 0; i < 12; i++) result += get_digit();
+    return result;
+}
+
+// Runs generate iterations times on each of threads threads and returns ns per nonce on one thread
+template<typename Generate>
+static double Measure(int iterations, int threads, Generate generate) {
+    std::vector<double> elapsed(threads);
+    std::vector<std::thread> workers;
+    for (int t = 0; t < threads; t++) {
+        workers.emplace_back([&, t] {
+            uint64_t checksum = 0;
+            auto start = Clock::now();
+            for (int i = 0; i < iterations; i++) checksum += static_cast<unsigned char>(generate(i)[35]);
+            elapsed[t] = std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+
+            // Keeps the work from being optimized away
+            if (checksum == 0) std::println("no nonces generated");
+        });
+    }
+    for (auto& worker : workers) worker.join();
+    return *std::ranges::max_element(elapsed) / iterations;
+}
+
+int main(int argc, char** argv) {
+    int iterations = 2000000;
+    if (argc > 1) {
+        std::string_view text = argv[1];
+        if (std::from_chars(text.data(), text.data() + text.size(), iterations).ec != std::errc() || iterations <= 0) {
+            std::println("Usage: nonce_bench [iterations]");
+            return 1;
+        }
+    }
+
+    int threads = static_cast<int>(std::clamp(std::thread::hardware_concurrency(), 2u, 8u));
+    const uint64_t prefix = UUID::NextRandom();
+
+    auto uuid = [](int) { return UUID::GenerateUUIDv4().chars; };
+    auto encoded = [prefix](int i) { return UUID::EncodeId(prefix, static_cast<uint64_t>(i)).chars; };
+
+    double uuid_single = Measure(iterations, 1, uuid);
+    double uuid_threaded = Measure(iterations, threads, uuid);
+    double encoded_single = Measure(iterations, 1, encoded);
+    double encoded_threaded = Measure(iterations, threads, encoded);
+    double twister = Measure(iterations, 1, [](int) { return GenerateWithMersenneTwister(); });
+
+    std::println("{} nonces per thread, ns each", iterations);
+    std::println("  {:<28} {:>10} {:>10}", "", "1 thread", std::format("{} threads", threads));
+    std::println("  {:<28} {:10.1f} {:10.1f}", "UUID::GenerateUUIDv4", uuid_single, uuid_threaded);
+    std::println("  {:<28} {:10.1f} {:10.1f}", "UUID::EncodeId", encoded_single, encoded_threaded);
+    std::println("  {:<28} {:10.1f} {:>10}", "mt19937, digit by digit", twister, "-");
+    return 0;
+}
@@ -0,0 +1,65 @@
+#include "drpc/drpc.hpp"
+
+#include <charconv>
+#include <chrono>
+#include <cstdint>
+#include <print>
+#include <string>
+#include <string_view>
+
+// Formats the numbers an activity update carries: the pid, the application's client_id, start and
+// end timestamps and the party's current and maximum size. Compares JsonWriter::WriteNumber with
+// the std::to_string temporaries it replaced.
+
+using namespace DiscordRichPresence;
+using Clock = std::chrono::steady_clock;
+
+template<typename T>
+static double Measure(int iterations, T base, bool with_to_string) {
+    JSON::JsonWriter writer(64);
+    size_t bytes = 0;
+
+    auto start = Clock::now();
+    for (int i = 0; i < iterations; i++) {
+        writer.Reset();
+        // Varies the value so the formatting can't be hoisted out of the loop
+        T n = base + static_cast<T>(i & 0xFF);
+        if (with_to_string)
+            writer.WriteRaw(std::to_string(n));
+        else
+            writer.WriteNumber(n);
+        bytes += writer.View().size();
+    }
+    auto elapsed = std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+
+    // Keeps the work from being optimized away
+    if (bytes == 0) std::println("nothing written");
+    return elapsed / iterations;
+}
+
+template<typename T>
+static void Report(int iterations, std::string_view field, T base) {
+    double direct = Measure(iterations, base, false);
+    double temporary = Measure(iterations, base, true);
+    std::println("  {:<16} {:10.1f} {:14.1f}", field, direct, temporary);
+}
+
+int main(int argc, char** argv) {
+    int iterations = 5000000;
+    if (argc > 1) {
+        std::string_view text = argv[1];
+        if (std::from_chars(text.data(), text.data() + text.size(), iterations).ec != std::errc() || iterations <= 0) {
+            std::println("Usage: number_bench [iterations]");
+            return 1;
+        }
+    }
+
+    std::println("{} numbers per field, ns each", iterations);
+    std::println("  {:<16} {:>10} {:>14}", "field", "to_chars", "to_string");
+    Report(iterations, "pid", 48213);
+    Report(iterations, "client_id", static_cast<uint64_t>(1355907951155740785));
+    Report(iterations, "timestamp start", static_cast<int64_t>(1700000000));
+    Report(iterations, "timestamp end", static_cast<int64_t>(1700003600000));
+    Report(iterations, "party size", 4);
+    return 0;
+}
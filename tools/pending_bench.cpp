@@ -0,0 +1,91 @@
+#include "drpc/drpc.hpp"
+
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <print>
+#include <random>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Keeps thousands of requests in flight and answers them in random order, the way Run matches
+// replies to callbacks. Compares the SlotTable keyed by the id carried in the nonce with the
+// std::map keyed by the nonce string that it replaced, including its contains, operator[] and erase.
+
+using namespace DiscordRichPresence;
+using Clock = std::chrono::steady_clock;
+
+using Callback = std::function<void(int)>;
+
+static double MeasureSlotTable(int rounds, size_t in_flight) {
+    const uint64_t prefix = UUID::NextRandom();
+    SlotTable<Callback> table;
+    std::vector<UUID::Uuid> nonces(in_flight);
+    std::mt19937 rng(1);
+    int answered = 0;
+
+    auto start = Clock::now();
+    for (int round = 0; round < rounds; round++) {
+        for (auto& nonce : nonces) nonce = UUID::EncodeId(prefix, table.Insert([&](int n) { answered += n; }));
+        std::ranges::shuffle(nonces, rng);
+
+        for (const auto& nonce : nonces) {
+            auto id = UUID::DecodeId(prefix, nonce.View());
+            if (!id || table.Find(*id) == nullptr) continue;
+            if (auto callback = table.Take(*id)) (*callback)(1);
+        }
+    }
+    auto elapsed = std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+
+    if (answered != rounds * static_cast<int>(in_flight)) std::println("slot table lost requests");
+    return elapsed / (static_cast<double>(rounds) * in_flight);
+}
+
+static double MeasureMap(int rounds, size_t in_flight) {
+    std::map<std::string, Callback> callbacks;
+    std::vector<std::string> nonces(in_flight);
+    std::mt19937 rng(1);
+    int answered = 0;
+
+    auto start = Clock::now();
+    for (int round = 0; round < rounds; round++) {
+        for (auto& nonce : nonces) {
+            nonce = std::string(UUID::GenerateUUIDv4().View());
+            callbacks[nonce] = [&](int n) { answered += n; };
+        }
+        std::ranges::shuffle(nonces, rng);
+
+        for (const auto& nonce : nonces) {
+            if (!callbacks.contains(nonce)) continue;
+            callbacks[nonce](1);
+            callbacks.erase(nonce);
+        }
+    }
+    auto elapsed = std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+
+    if (answered != rounds * static_cast<int>(in_flight)) std::println("map lost requests");
+    return elapsed / (static_cast<double>(rounds) * in_flight);
+}
+
+int main(int argc, char** argv) {
+    int requests = 2000000;
+    if (argc > 1) {
+        std::string_view text = argv[1];
+        if (std::from_chars(text.data(), text.data() + text.size(), requests).ec != std::errc() || requests <= 0) {
+            std::println("Usage: pending_bench [requests]");
+            return 1;
+        }
+    }
+
+    std::println("{} requests per row, ns per request from nonce to callback", requests);
+    std::println("  {:>10} {:>12} {:>12}", "in flight", "SlotTable", "std::map");
+    for (size_t in_flight : { 1000, 10000, 100000 }) {
+        int rounds = std::max(1, requests / static_cast<int>(in_flight));
+        std::println("  {:>10} {:12.1f} {:12.1f}", in_flight, MeasureSlotTable(rounds, in_flight), MeasureMap(rounds, in_flight));
+    }
+    return 0;
+}
@@ -0,0 +1,143 @@
+#include "drpc/drpc.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <chrono>
+#include <memory>
+#include <print>
+#include <span>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+// Serves a Client over a socket pair and counts how often its Run loop wakes up while nothing
+// happens, then how long an update takes from UpdateActivity to its callback. Once with the socket
+// watched by the reactor, once through a pipe without a poll handle, which Run checks every 100 ms
+// the way the loop slept between reads before it waited on the sockets.
+
+using namespace DiscordRichPresence;
+using Clock = std::chrono::steady_clock;
+
+// Answers the handshake with READY and every command with a reply carrying its nonce
+static void Serve(std::shared_ptr<Pipe> peer) {
+    IpcMessage message;
+    while (peer->Read(&message) == Result::Ok) {
+        IpcFrameWriter writer(1, 256);
+        if (message.op_code == 0) {
+            writer.WriteRaw(R"({"cmd":"DISPATCH","data":{"v":1,"config":{"cdn_host":"cdn.discordapp.com",)"
+                R"("api_endpoint":"//discord.com/api","environment":"production"},"user":{"id":"1","username":"mock",)"
+                R"("discriminator":"0","global_name":"Mock","avatar":null}},"evt":"READY","nonce":null})");
+        } else {
+            writer.BeginObject();
+            writer.Put("cmd", "SET_ACTIVITY");
+            writer.PendMember("data");
+            writer.WriteRaw("null");
+            writer.Put("evt", nullptr);
+            writer.Put("nonce", message.Nonce());
+            writer.EndObject();
+        }
+
+        if (peer->Write(writer.Finish()) != Result::Ok) return;
+    }
+}
+
+// Hides the poll handle of the pipe it wraps, so Run has to poll it
+class PolledPipe final : public Pipe {
+public:
+    explicit PolledPipe(std::shared_ptr<Pipe> pipe) : pipe(std::move(pipe)) {}
+
+    Result Open() override { return pipe->Open(); }
+    Result Close() override { return pipe->Close(); }
+    Result Read(IpcMessage* message, bool peek = false) override { return pipe->Read(message, peek); }
+    void CancelIo() override { pipe->CancelIo(); }
+    Result Write(std::string_view frame) override { return pipe->Write(frame); }
+
+    Result WriteBatch(std::span<const std::string_view> frames, size_t offset, size_t* written) override {
+        return pipe->WriteBatch(frames, offset, written);
+    }
+
+    bool IsOpen() override { return pipe->IsOpen(); }
+private:
+    std::shared_ptr<Pipe> pipe;
+};
+
+struct Measurement {
+    double idle_wakeups_per_second;
+    double p50_ms;
+    double p99_ms;
+};
+
+static bool Measure(int updates, bool polled, Measurement* measurement) {
+    auto [mine, theirs] = SocketPairPipe::CreatePair();
+    if (mine == nullptr) return false;
+    std::thread(Serve, theirs).detach();
+
+    std::shared_ptr<Pipe> pipe = mine;
+    if (polled) pipe = std::make_shared<PolledPipe>(pipe);
+
+    ClientSettings settings;
+    settings.rate_limit_burst = 0; // every update goes out right away
+    settings.pipe_factory = [pipe](int) { return pipe; };
+
+    // Run never returns, so the client outlives this function
+    auto* client = new Client(123, settings);
+    if (client->Connect() != Result::Ok) return false;
+    std::thread([client] { client->Run(); }).detach();
+
+    // Settle, then count the wakeups of a client with nothing to do
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    auto idle = std::chrono::seconds(2);
+    uint64_t before = client->GetWakeups();
+    std::this_thread::sleep_for(idle);
+    measurement->idle_wakeups_per_second = static_cast<double>(client->GetWakeups() - before) / idle.count();
+
+    std::vector<double> latencies_ms;
+    auto activity = std::make_shared<Activity>();
+    activity->SetName("drpc");
+    for (int i = 0; i < updates; i++) {
+        // A new state every time, so no update is skipped as already shown
+        activity->SetState(std::to_string(i));
+
+        std::atomic<bool> answered = false;
+        Result result = Result::Ok;
+        auto start = Clock::now();
+        client->UpdateActivity(activity, [&](Result r, const IpcMessage&) {
+            result = r;
+            answered.store(true, std::memory_order_release);
+        });
+        while (!answered.load(std::memory_order_acquire)) std::this_thread::sleep_for(std::chrono::microseconds(50));
+
+        if (result != Result::Ok) return false;
+        latencies_ms.push_back(std::chrono::duration<double, std::milli>(Clock::now() - start).count());
+    }
+
+    std::ranges::sort(latencies_ms);
+    measurement->p50_ms = latencies_ms[latencies_ms.size() / 2];
+    measurement->p99_ms = latencies_ms[std::min(latencies_ms.size() - 1, latencies_ms.size() * 99 / 100)];
+    return true;
+}
+
+int main(int argc, char** argv) {
+    int updates = 50;
+    if (argc > 1) {
+        std::string_view text = argv[1];
+        if (std::from_chars(text.data(), text.data() + text.size(), updates).ec != std::errc() || updates <= 0) {
+            std::println("Usage: reactor_bench [updates]");
+            return 1;
+        }
+    }
+
+    Measurement watched, polled;
+    if (!Measure(updates, false, &watched) || !Measure(updates, true, &polled)) {
+        std::println(stderr, "Failed to serve the client");
+        return 1;
+    }
+
+    std::println("Wakeups of an idle client over 2 s, then {} updates one after another", updates);
+    std::println("  {:<26} {:>12} {:>10} {:>10}", "", "wakeups/s", "p50 ms", "p99 ms");
+    std::println("  {:<26} {:12.1f} {:10.3f} {:10.3f}", "socket watched by epoll", watched.idle_wakeups_per_second, watched.p50_ms, watched.p99_ms);
+    std::println("  {:<26} {:12.1f} {:10.3f} {:10.3f}", "polled every 100 ms", polled.idle_wakeups_per_second, polled.p50_ms, polled.p99_ms);
+    return 0;
+}
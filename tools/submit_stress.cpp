@@ -0,0 +1,232 @@
+#include "drpc/drpc.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <chrono>
+#include <cstdint>
+#include <format>
+#include <memory>
+#include <print>
+#include <span>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+// Several threads submit activity updates at once while an in-process peer answers them over a
+// LoopbackPipe, or with --pipe socketpair over a SocketPairPipe. Reports throughput, how long submitting blocked the caller and whether every
+// callback ran exactly once. With --reconnect-ms another thread reconnects the client while Run is
+// serving it, every other time leaving it disconnected for a moment so updates pile up meanwhile.
+// Meant to be built with -fsanitize=thread as well.
+
+using namespace DiscordRichPresence;
+using Clock = std::chrono::steady_clock;
+
+struct Options {
+    int threads = 4;
+    int count = 100000;
+    size_t capacity = 1024;
+    int reconnect_ms = 0;
+    bool socket_pair = false;
+};
+
+static void PrintUsage() {
+    std::println("Usage: submit_stress [options]");
+    std::println("  --threads N         submitting threads (default 4)");
+    std::println("  --count N           updates per thread (default 100000)");
+    std::println("  --capacity N        submission queue capacity (default 1024)");
+    std::println("  --reconnect-ms N    call Reconnect every N ms while submitting (default 0, never)");
+    std::println("  --pipe KIND         loopback or socketpair (default loopback)");
+}
+
+template<typename T>
+static bool ParseValue(std::string_view text, T* value) {
+    auto [end, ec] = std::from_chars(text.data(), text.data() + text.size(), *value);
+    return ec == std::errc() && end == text.data() + text.size();
+}
+
+static bool ParseOptions(int argc, char** argv, Options* options) {
+    for (int i = 1; i < argc; i++) {
+        std::string_view flag = argv[i];
+        if (i + 1 >= argc) return false;
+        std::string_view value = argv[++i];
+
+        bool ok = true;
+        if (flag == "--threads") ok = ParseValue(value, &options->threads);
+        else if (flag == "--count") ok = ParseValue(value, &options->count);
+        else if (flag == "--capacity") ok = ParseValue(value, &options->capacity);
+        else if (flag == "--reconnect-ms") ok = ParseValue(value, &options->reconnect_ms);
+        else if (flag == "--pipe") {
+            ok = value == "loopback" || value == "socketpair";
+            options->socket_pair = value == "socketpair";
+        }
+        else ok = false;
+
+        if (!ok) return false;
+    }
+    return options->threads > 0 && options->count > 0 && options->capacity > 0 && options->reconnect_ms >= 0;
+}
+
+// Answers the handshake with READY and every command with a reply carrying its nonce
+static void Serve(std::shared_ptr<Pipe> peer) {
+    IpcMessage message;
+    while (peer->Read(&message) == Result::Ok) {
+        IpcFrameWriter writer(1, 256);
+        if (message.op_code == 0) {
+            writer.WriteRaw(R"({"cmd":"DISPATCH","data":{"v":1,"config":{"cdn_host":"cdn.discordapp.com",)"
+                R"("api_endpoint":"//discord.com/api","environment":"production"},"user":{"id":"1","username":"mock",)"
+                R"("discriminator":"0","global_name":"Mock","avatar":null}},"evt":"READY","nonce":null})");
+        } else {
+            writer.BeginObject();
+            writer.Put("cmd", "SET_ACTIVITY");
+            writer.PendMember("data");
+            writer.WriteRaw("null");
+            writer.Put("evt", nullptr);
+            writer.Put("nonce", message.Nonce());
+            writer.EndObject();
+        }
+
+        if (peer->Write(writer.Finish()) != Result::Ok) return;
+    }
+}
+
+// A peer that can be connected to again: every Open after a Close makes a new pair and serves its
+// other end on a thread of its own
+class ReopeningPipe final : public Pipe {
+public:
+    explicit ReopeningPipe(bool socket_pair) : socket_pair(socket_pair) {
+        Open();
+    }
+
+    Result Open() override {
+        if (pipe != nullptr && pipe->IsOpen()) return Result::Ok;
+
+        std::shared_ptr<Pipe> theirs;
+        if (socket_pair) std::tie(pipe, theirs) = SocketPairPipe::CreatePair();
+        else std::tie(pipe, theirs) = LoopbackPipe::CreatePair();
+        if (pipe == nullptr) return Result::OpenPipeFailed;
+
+        std::thread(Serve, theirs).detach();
+        return Result::Ok;
+    }
+
+    Result Close() override { return pipe != nullptr ? pipe->Close() : Result::Ok; }
+    Result Read(IpcMessage* message, bool peek = false) override { return pipe->Read(message, peek); }
+    void CancelIo() override { pipe->CancelIo(); }
+    Result Write(std::string_view frame) override { return pipe->Write(frame); }
+
+    Result WriteBatch(std::span<const std::string_view> frames, size_t offset, size_t* written) override {
+        return pipe->WriteBatch(frames, offset, written);
+    }
+
+    bool IsOpen() override { return pipe != nullptr && pipe->IsOpen(); }
+    int PollHandle() override { return pipe->PollHandle(); }
+    int SpaceHandle() override { return pipe->SpaceHandle(); }
+private:
+    bool socket_pair;
+    std::shared_ptr<Pipe> pipe;
+};
+
+int main(int argc, char** argv) {
+    Options options;
+    if (!ParseOptions(argc, argv, &options)) {
+        PrintUsage();
+        return 1;
+    }
+
+    ClientSettings settings;
+    settings.submit_queue_capacity = options.capacity;
+    settings.rate_limit_burst = 0; // measures the submission path, not Discord's limits
+    settings.pipe_factory = [socket_pair = options.socket_pair](int) { return std::make_shared<ReopeningPipe>(socket_pair); };
+
+    // Run never returns, so the client outlives main
+    auto* client = new Client(123, settings);
+    if (auto result = client->Connect(); result != Result::Ok) {
+        std::println(stderr, "Failed to connect: {}", ResultToString(result));
+        return 1;
+    }
+    std::thread([client] { client->Run(); }).detach();
+
+    uint64_t total = static_cast<uint64_t>(options.threads) * options.count;
+    // Static, since callbacks may still run on the Run thread after main gave up waiting
+    static std::atomic<uint64_t> ok = 0, full = 0, dropped = 0, failed = 0;
+    std::vector<std::vector<double>> submit_us(options.threads);
+
+    auto start = Clock::now();
+    std::vector<std::thread> producers;
+    for (int t = 0; t < options.threads; t++) {
+        producers.emplace_back([&, t] {
+            auto activity = std::make_shared<Activity>();
+            activity->SetName("drpc");
+            activity->SetDetails(std::format("producer {}", t));
+
+            auto& samples = submit_us[t];
+            samples.reserve(options.count);
+            for (int i = 0; i < options.count; i++) {
+                // Every update differs from the last, so none is skipped as already shown
+                activity->SetState(std::to_string(i));
+
+                auto before = Clock::now();
+                client->UpdateActivity(activity, [](Result result, const IpcMessage&) {
+                    if (result == Result::Ok) ok++;
+                    else if (result == Result::QueueFull) full++;
+                    else if (result == Result::PipeNotOpen) dropped++; // in flight when the client reconnected
+                    else failed++;
+                });
+                samples.push_back(std::chrono::duration<double, std::micro>(Clock::now() - before).count());
+            }
+        });
+    }
+
+    std::atomic<bool> submitting = true;
+    int reconnects = 0, failed_reconnects = 0;
+    std::thread reconnector([&] {
+        for (int round = 0; options.reconnect_ms > 0 && submitting; round++) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(options.reconnect_ms));
+
+            Result result;
+            if (round % 2 == 0) {
+                result = client->Reconnect();
+            } else {
+                result = client->Disconnect();
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                if (result == Result::Ok) result = client->Connect();
+            }
+
+            if (result == Result::Ok) reconnects++;
+            else failed_reconnects++;
+        }
+    });
+
+    for (auto& producer : producers) producer.join();
+    auto submitted = Clock::now();
+    submitting = false;
+    reconnector.join();
+
+    while (ok + full + dropped + failed < total) {
+        if (Clock::now() - submitted > std::chrono::seconds(30)) break;
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    auto finished = Clock::now();
+
+    std::vector<double> samples;
+    for (auto& thread_samples : submit_us) samples.insert(samples.end(), thread_samples.begin(), thread_samples.end());
+    std::ranges::sort(samples);
+    auto percentile = [&](double p) { return samples[std::min(samples.size() - 1, static_cast<size_t>(p * samples.size()))]; };
+
+    double seconds = std::chrono::duration<double>(finished - start).count();
+    uint64_t answered = ok + full + dropped + failed;
+    std::println("{} threads x {} updates over {}, queue capacity {}", options.threads, options.count,
+        options.socket_pair ? "a socket pair" : "a loopback pipe", options.capacity);
+    std::println("  answered {} of {} ({} ok, {} queue full, {} dropped by reconnects, {} failed) in {:.3f} s, {:.0f} updates/s",
+        answered, total, ok.load(), full.load(), dropped.load(), failed.load(), seconds, ok / seconds);
+    if (options.reconnect_ms > 0) std::println("  reconnected {} times, {} failed", reconnects, failed_reconnects);
+    std::println("  {} skipped as already shown", client->GetSuppressedUpdates());
+    std::println("  submit call p50 {:.2f} us, p99 {:.2f} us, max {:.2f} us", percentile(0.5), percentile(0.99), samples.back());
+
+    // Only a reconnect may drop an update
+    bool dropped_ok = dropped == 0 || options.reconnect_ms > 0;
+    return answered == total && failed == 0 && dropped_ok && failed_reconnects == 0 ? 0 : 1;
+}
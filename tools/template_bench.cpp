@@ -0,0 +1,105 @@
+#include "drpc/drpc.hpp"
+
+#include <charconv>
+#include <chrono>
+#include <cstdint>
+#include <format>
+#include <memory>
+#include <print>
+#include <string>
+#include <string_view>
+#include <utility>
+
+// Compares the ways of rendering an activity whose details change on every update: serializing
+// the whole Activity, Activity::ToJson with its field cache, and splicing values into an
+// ActivityTemplate.
+
+using namespace DiscordRichPresence;
+using Clock = std::chrono::steady_clock;
+
+static Activity MakeActivity(std::string details) {
+    Activity activity;
+    activity.SetName("drpc");
+    activity.SetDetails(std::move(details));
+    activity.SetState("In a match");
+    activity.GetTimestamps()->SetStart(1700000000);
+
+    auto assets = activity.GetAssets();
+    assets->SetLargeImage("map_harbor");
+    assets->SetLargeImageText("Harbor");
+    assets->SetSmallImage("rank_gold");
+    assets->SetSmallImageText("Gold III");
+
+    auto party = std::make_shared<Party>();
+    party->SetId("lobby-1234");
+    party->SetCurrentSize(3);
+    party->SetMaxSize(4);
+    activity.SetParty(party);
+
+    activity.AddButton(std::make_shared<Button>("Join", "https://example.com/join/1234"));
+    return activity;
+}
+
+template<typename Render>
+static double Measure(int iterations, Render render) {
+    JSON::JsonWriter writer(1024);
+    size_t bytes = 0;
+
+    auto start = Clock::now();
+    for (int i = 0; i < iterations; i++) {
+        writer.Reset();
+        render(writer, i);
+        bytes += writer.View().size();
+    }
+    auto elapsed = std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+
+    // Keeps the work from being optimized away
+    if (bytes == 0) std::println("nothing rendered");
+    return elapsed / iterations;
+}
+
+int main(int argc, char** argv) {
+    int iterations = 1000000;
+    if (argc > 1) {
+        std::string_view text = argv[1];
+        if (std::from_chars(text.data(), text.data() + text.size(), iterations).ec != std::errc() || iterations <= 0) {
+            std::println("Usage: template_bench [iterations]");
+            return 1;
+        }
+    }
+
+    Activity activity = MakeActivity("Score 0 on level 1");
+    ActivityTemplate activity_template(MakeActivity("Score {score} on level {level}"));
+
+    char score[20];
+    char level[20];
+    auto details = [&](int i) {
+        auto score_end = std::to_chars(score, std::end(score), i * 10).ptr;
+        auto level_end = std::to_chars(level, std::end(level), i / 1000 + 1).ptr;
+        return std::pair(std::string_view(score, score_end), std::string_view(level, level_end));
+    };
+
+    double full = Measure(iterations, [&](JSON::JsonWriter& writer, int i) {
+        auto [score_text, level_text] = details(i);
+        activity.SetDetails(std::format("Score {} on level {}", score_text, level_text));
+        JSON::Serialize(&writer, activity);
+    });
+
+    double cached = Measure(iterations, [&](JSON::JsonWriter& writer, int i) {
+        auto [score_text, level_text] = details(i);
+        activity.SetDetails(std::format("Score {} on level {}", score_text, level_text));
+        activity.ToJson(&writer);
+    });
+
+    double spliced = Measure(iterations, [&](JSON::JsonWriter& writer, int i) {
+        auto [score_text, level_text] = details(i);
+        TemplateValue values[] = { { "score", score_text }, { "level", level_text } };
+        activity_template.Render(&writer, values);
+    });
+
+    std::println("{} updates, details changing every time", iterations);
+    std::println("  Activity, full serialize  {:8.1f} ns", full);
+    std::println("  Activity::ToJson, cached  {:8.1f} ns", cached);
+    std::println("  ActivityTemplate::Render  {:8.1f} ns", spliced);
+    return 0;
+}
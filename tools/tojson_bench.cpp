@@ -0,0 +1,148 @@
+#include "drpc/drpc.hpp"
+
+#include <charconv>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <memory>
+#include <new>
+#include <print>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// Counts heap allocations and ns per update for serializing the example Activity: through
+// Activity::ToJson with and without a changed field, through JSON::Serialize, and as a tree of
+// JsonValue temporaries holding the same payload, which is how every field used to be written.
+
+using namespace DiscordRichPresence;
+using Clock = std::chrono::steady_clock;
+
+static size_t allocations = 0;
+
+// GCC pairs the inlined free() with the operator new call rather than with this replacement
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+
+void* operator new(size_t size) {
+    allocations++;
+    if (void* p = std::malloc(size)) return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete(void* p, size_t) noexcept { std::free(p); }
+
+static Activity MakeActivity() {
+    Activity activity;
+    activity.SetClientId(1355907951155740785);
+    activity.SetName("drpc");
+    activity.SetDetails("Line 1");
+    activity.GetTimestamps()->SetStart(1700000000);
+
+    auto assets = activity.GetAssets();
+    assets->SetLargeImage("my_image");
+    assets->SetLargeImageText("You hovered over the large image");
+    assets->SetSmallImage("my_image");
+    assets->SetSmallImageText("I didn't have another image");
+
+    auto party = std::make_shared<Party>();
+    party->SetId("test");
+    party->SetCurrentSize(2);
+    party->SetMaxSize(5);
+    activity.SetParty(party);
+    activity.SetState("Party");
+
+    activity.AddButton(std::make_shared<Button>("Test", "https://yooksch.com"));
+    activity.AddButton(std::make_shared<Button>("Test 2", "https://youtu.be/dQw4w9WgXcQ"));
+    return activity;
+}
+
+static JSON::JsonValue MakeTree(std::string_view details) {
+    using Members = std::vector<std::pair<std::string, JSON::JsonValue>>;
+    return Members {
+        { "name", "drpc" },
+        { "type", 0 },
+        { "details", details },
+        { "state", "Party" },
+        { "timestamps", Members { { "start", static_cast<int64_t>(1700000000) } } },
+        { "party", Members { { "id", "test" }, { "size", std::vector<JSON::JsonValue> { 2, 5 } } } },
+        { "assets", Members {
+            { "large_image", "my_image" },
+            { "large_text", "You hovered over the large image" },
+            { "small_image", "my_image" },
+            { "small_text", "I didn't have another image" }
+        } },
+        { "buttons", std::vector<JSON::JsonValue> {
+            Members { { "label", "Test" }, { "url", "https://yooksch.com" } },
+            Members { { "label", "Test 2" }, { "url", "https://youtu.be/dQw4w9WgXcQ" } }
+        } }
+    };
+}
+
+struct Measurement {
+    double ns;
+    double allocations;
+};
+
+template<typename Render>
+static Measurement Measure(int iterations, Render render) {
+    JSON::JsonWriter writer(1024);
+    size_t bytes = 0;
+    size_t allocations_before = allocations;
+
+    auto start = Clock::now();
+    for (int i = 0; i < iterations; i++) {
+        writer.Reset();
+        render(writer, i);
+        bytes += writer.View().size();
+    }
+    auto elapsed = std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+
+    // Keeps the work from being optimized away
+    if (bytes == 0) std::println("nothing rendered");
+    return { elapsed / iterations, static_cast<double>(allocations - allocations_before) / iterations };
+}
+
+int main(int argc, char** argv) {
+    int iterations = 200000;
+    if (argc > 1) {
+        std::string_view text = argv[1];
+        if (std::from_chars(text.data(), text.data() + text.size(), iterations).ec != std::errc() || iterations <= 0) {
+            std::println("Usage: tojson_bench [iterations]");
+            return 1;
+        }
+    }
+
+    Activity activity = MakeActivity();
+    // Short enough for std::string's small buffer, so SetDetails itself does not allocate
+    const char* details[] = { "Line 1", "Line 2" };
+
+    auto unchanged = Measure(iterations, [&](JSON::JsonWriter& writer, int) {
+        activity.ToJson(&writer);
+    });
+
+    auto changed = Measure(iterations, [&](JSON::JsonWriter& writer, int i) {
+        activity.SetDetails(details[i & 1]);
+        activity.ToJson(&writer);
+    });
+
+    auto serialized = Measure(iterations, [&](JSON::JsonWriter& writer, int i) {
+        activity.SetDetails(details[i & 1]);
+        JSON::Serialize(&writer, activity);
+    });
+
+    auto tree = Measure(iterations, [&](JSON::JsonWriter& writer, int i) {
+        MakeTree(details[i & 1]).ToJson(&writer);
+    });
+
+    std::println("{} serializations of the example activity", iterations);
+    std::println("  Activity::ToJson, unchanged       {:8.1f} ns {:6.2f} allocs", unchanged.ns, unchanged.allocations);
+    std::println("  Activity::ToJson, details changed {:8.1f} ns {:6.2f} allocs", changed.ns, changed.allocations);
+    std::println("  JSON::Serialize                   {:8.1f} ns {:6.2f} allocs", serialized.ns, serialized.allocations);
+    std::println("  JsonValue tree                    {:8.1f} ns {:6.2f} allocs", tree.ns, tree.allocations);
+    return 0;
+}
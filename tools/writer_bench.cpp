@@ -0,0 +1,115 @@
+#include "drpc/drpc.hpp"
+
+#include <charconv>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <memory>
+#include <new>
+#include <print>
+#include <string_view>
+
+// Serializes the example Activity in full, bypassing its field cache, once with a new JsonWriter
+// per update and once with a single writer that is Reset between updates. Reports ns/op and heap
+// allocations per update.
+
+using namespace DiscordRichPresence;
+using Clock = std::chrono::steady_clock;
+
+static size_t allocations = 0;
+
+// GCC pairs the inlined free() with the operator new call rather than with this replacement
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+
+void* operator new(size_t size) {
+    allocations++;
+    if (void* p = std::malloc(size)) return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete(void* p, size_t) noexcept { std::free(p); }
+
+static std::shared_ptr<Activity> MakeActivity() {
+    auto activity = std::make_shared<Activity>();
+    activity->SetClientId(1355907951155740785);
+    activity->SetName("drpc");
+    activity->SetDetails("Line 1");
+    activity->GetTimestamps()->SetStart(1700000000);
+
+    auto assets = activity->GetAssets();
+    assets->SetLargeImage("my_image");
+    assets->SetLargeImageText("You hovered over the large image");
+    assets->SetSmallImage("my_image");
+    assets->SetSmallImageText("I didn't have another image");
+
+    auto party = std::make_shared<Party>();
+    party->SetId("test");
+    party->SetCurrentSize(2);
+    party->SetMaxSize(5);
+    activity->SetParty(party);
+    activity->SetState("Party");
+
+    activity->AddButton(std::make_shared<Button>("Test", "https://yooksch.com"));
+    activity->AddButton(std::make_shared<Button>("Test 2", "https://youtu.be/dQw4w9WgXcQ"));
+    return activity;
+}
+
+struct Measurement {
+    double ns;
+    double allocations;
+};
+
+template<typename Render>
+static Measurement Measure(int iterations, Render render) {
+    size_t bytes = 0;
+    size_t allocations_before = allocations;
+
+    auto start = Clock::now();
+    for (int i = 0; i < iterations; i++) bytes += render();
+    auto elapsed = std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+
+    // Keeps the work from being optimized away
+    if (bytes == 0) std::println("nothing rendered");
+    return { elapsed / iterations, static_cast<double>(allocations - allocations_before) / iterations };
+}
+
+int main(int argc, char** argv) {
+    int iterations = 200000;
+    if (argc > 1) {
+        std::string_view text = argv[1];
+        if (std::from_chars(text.data(), text.data() + text.size(), iterations).ec != std::errc() || iterations <= 0) {
+            std::println("Usage: writer_bench [iterations]");
+            return 1;
+        }
+    }
+
+    auto activity = MakeActivity();
+
+    auto fresh = Measure(iterations, [&] {
+        JSON::JsonWriter writer;
+        writer.BeginObject();
+        writer.PendMember("activity");
+        JSON::Serialize(&writer, *activity);
+        writer.EndObject();
+        return writer.Release().size();
+    });
+
+    JSON::JsonWriter writer(1024);
+    auto reused = Measure(iterations, [&] {
+        writer.Reset();
+        writer.BeginObject();
+        writer.PendMember("activity");
+        JSON::Serialize(&writer, *activity);
+        writer.EndObject();
+        return writer.View().size();
+    });
+
+    std::println("{} serializations of the example activity", iterations);
+    std::println("  new writer each time  {:8.1f} ns {:6.2f} allocs", fresh.ns, fresh.allocations);
+    std::println("  reused writer         {:8.1f} ns {:6.2f} allocs", reused.ns, reused.allocations);
+    return 0;
+}